@@ -1,23 +1,201 @@
 #include "command.hpp"
+#include "chunk_scheduler.hpp"
+#include "buffer_pool.hpp"
+#include "transfer_session.hpp"
+#include "transfer_journal.hpp"
+#include "transfer_pipeline.hpp"
+#include "mapped_file.hpp"
+#include "local_io_engine.hpp"
+#include "genquery.hpp"
 
 #include <irods/rodsClient.h>
-#include <irods/connection_pool.hpp>
+#include <irods/thread_pool.hpp>
 #include <irods/dstream.hpp>
 #include <irods/transport/default_transport.hpp>
 #include <irods/filesystem.hpp>
+#include <irods/irods_query.hpp>
 
 #include <boost/config.hpp>
 #include <boost/program_options.hpp>
+#include <boost/filesystem.hpp>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
 
 #include <iostream>
 #include <string>
-#include <array>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ctime>
+#include <utility>
 #include <vector>
+#include <stdexcept>
+
+// clang-format off
+namespace fs  = boost::filesystem;
+namespace po  = boost::program_options;
+
+namespace io  = irods::experimental::io;
+namespace ifs = irods::experimental::filesystem;
+// clang-format on
+
+namespace
+{
+    constexpr auto operator ""_MB(unsigned long long x) noexcept -> int
+    {
+        return x * 1024 * 1024;
+    }
+
+    // A local destination file. Closes the descriptor when destroyed.
+    class local_file
+    {
+    public:
+        // Opens (or creates) the file and reserves _size bytes for it, so that
+        // ranges can be written at their offsets in any order without the file
+        // system having to extend the file or fragment its extents. File systems
+        // without fallocate(2) support get a sparse file of the right size.
+        // Unless resuming, any previous content is discarded.
+        local_file(const fs::path& _path, std::uintmax_t _size, bool _resume)
+            : path_{_path}
+            , fd_{::open(_path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC | (_resume ? 0 : O_TRUNC), 0644)}
+        {
+            if (fd_ < 0) {
+                throw std::runtime_error{"Cannot open file for writing [path: " + path_.generic_string() + ", error: " + std::strerror(errno) + "]."};
+            }
+
+            if (_size == 0) {
+                return;
+            }
+
+            preallocated_ = ::fallocate(fd_, 0, 0, static_cast<off_t>(_size)) == 0;
+
+            if (!preallocated_ && ::ftruncate(fd_, static_cast<off_t>(_size)) != 0) {
+                const auto error = errno;
+                ::close(fd_);
+                throw std::runtime_error{"Cannot allocate file [path: " + path_.generic_string() + ", error: " + std::strerror(error) + "]."};
+            }
+        }
+
+        local_file(const local_file&) = delete;
+        auto operator=(const local_file&) -> local_file& = delete;
 
-namespace fs = irods::experimental::filesystem::client;
-namespace io = irods::experimental::io;
+        ~local_file()
+        {
+            ::close(fd_);
+        }
+
+        auto fd() const noexcept -> int
+        {
+            return fd_;
+        }
+
+        // True if the blocks of the file have been reserved. Only such files are
+        // safe to write through a memory mapping: a sparse file running out of
+        // space would raise SIGBUS instead of reporting an error.
+        auto preallocated() const noexcept -> bool
+        {
+            return preallocated_;
+        }
+
+        // Writes the whole buffer at the given offset. Safe to call concurrently
+        // from several threads for disjoint ranges.
+        auto write_at(std::uintmax_t _offset, const char* _data, std::size_t _size) -> void
+        {
+            while (_size > 0) {
+                const auto n = ::pwrite(fd_, _data, _size, static_cast<off_t>(_offset));
 
-namespace po = boost::program_options;
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+
+                if (n <= 0) {
+                    throw std::runtime_error{"Cannot write file [path: " + path_.generic_string() + ", error: " + std::strerror(errno) + "]."};
+                }
+
+                _data += n;
+                _size -= static_cast<std::size_t>(n);
+                _offset += static_cast<std::uintmax_t>(n);
+            }
+        }
+
+    private:
+        const fs::path path_;
+        const int fd_;
+        bool preallocated_ = false;
+    }; // class local_file
+
+    // Returns true if _fd is a pipe that can be fed with splice_to_pipe() using
+    // blocks of _block_size bytes.
+    auto is_spliceable_pipe(int _fd, std::size_t _block_size) -> bool
+    {
+        struct stat st;
+
+        if (::fstat(_fd, &st) != 0 || !S_ISFIFO(st.st_mode)) {
+            return false;
+        }
+
+        const auto capacity = ::fcntl(_fd, F_GETPIPE_SZ);
+
+        return capacity > 0 && static_cast<std::size_t>(capacity) <= _block_size;
+    }
+
+    // Moves a block into a pipe with vmsplice(2). The pipe references the pages
+    // of the block instead of copying them, so the block must not be modified
+    // until the reader has consumed it. Since a pipe holds no more than its
+    // capacity, that is guaranteed once another block at least as large as the
+    // capacity has been spliced after it, or once wait_for_pipe_drain() returns.
+    auto splice_to_pipe(int _fd, const char* _data, std::size_t _size) -> void
+    {
+        iovec iov{const_cast<char*>(_data), _size};
+
+        while (iov.iov_len > 0) {
+            const auto n = ::vmsplice(_fd, &iov, 1, 0);
+
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+
+            if (n <= 0) {
+                throw std::runtime_error{std::string{"Could not write to stdout [error: "} + std::strerror(errno) + "]."};
+            }
+
+            iov.iov_base = static_cast<char*>(iov.iov_base) + n;
+            iov.iov_len -= static_cast<std::size_t>(n);
+        }
+    }
+
+    // Waits until the reader has consumed everything in the pipe, or has gone
+    // away.
+    auto wait_for_pipe_drain(int _fd) -> void
+    {
+        while (true) {
+            int pending = 0;
+
+            if (::ioctl(_fd, FIONREAD, &pending) != 0 || pending == 0) {
+                return;
+            }
+
+            pollfd pfd{_fd, 0, 0};
+
+            if (::poll(&pfd, 1, 10) > 0 && (pfd.revents & POLLERR)) {
+                return;
+            }
+        }
+    }
+} // anonymous namespace
 
 namespace irods::cli
 {
@@ -44,7 +222,20 @@ namespace irods::cli
             po::options_description desc{""};
             desc.add_options()
                 ("logical_path", po::value<std::string>(), "")
-                ("physical_path", po::value<std::string>(), "");
+                ("physical_path", po::value<std::string>(), "")
+                ("connection_pool_size,c", po::value<int>()->default_value(4), "")
+                ("chunk_size", po::value<int>()->default_value(32), "")
+                ("buffer_size", po::value<int>()->default_value(4), "")
+                ("buffer_memory_limit", po::value<int>()->default_value(256), "")
+                ("pipeline_depth", po::value<int>()->default_value(2), "")
+                ("segment_size", po::value<int>()->default_value(8), "")
+                ("in_flight_segments", po::value<int>()->default_value(8), "")
+                ("prefetch", "")
+                ("recursive,r", "")
+                ("resume", "")
+                ("journal", po::value<std::string>(), "")
+                ("zero_copy", "")
+                ("io_depth", po::value<int>()->default_value(4), "");
 
             po::positional_options_description pod;
             pod.add("logical_path", 1);
@@ -64,8 +255,38 @@ namespace irods::cli
                 return 1;
             }
 
-            if ("-" != vm["physical_path"].as<std::string>()) {
-                std::cerr << "Error: Physical path must be '-'.\n";
+            if (vm["connection_pool_size"].as<int>() < 1) {
+                std::cerr << "Error: Connection pool size must be greater than zero.\n";
+                return 1;
+            }
+
+            if (vm["chunk_size"].as<int>() < 1) {
+                std::cerr << "Error: Chunk size must be greater than zero.\n";
+                return 1;
+            }
+
+            if (vm["buffer_size"].as<int>() < 1) {
+                std::cerr << "Error: Buffer size must be greater than zero.\n";
+                return 1;
+            }
+
+            if (vm["buffer_memory_limit"].as<int>() < vm["buffer_size"].as<int>()) {
+                std::cerr << "Error: Buffer memory limit must be at least as large as the buffer size.\n";
+                return 1;
+            }
+
+            if (vm["pipeline_depth"].as<int>() < 1) {
+                std::cerr << "Error: Pipeline depth must be greater than zero.\n";
+                return 1;
+            }
+
+            if (vm["io_depth"].as<int>() < 1) {
+                std::cerr << "Error: I/O depth must be greater than zero.\n";
+                return 1;
+            }
+
+            if (vm["segment_size"].as<int>() < 1 || vm["in_flight_segments"].as<int>() < 1) {
+                std::cerr << "Error: Segment size and in-flight segments must be greater than zero.\n";
                 return 1;
             }
 
@@ -76,35 +297,816 @@ namespace irods::cli
                 return 1;
             }
 
-            const auto logical_path = vm["logical_path"].as<std::string>();
-            irods::connection_pool conn_pool{1, env.rodsHost, env.rodsPort, env.rodsUserName, env.rodsZone, 600};
+            buffers_ = std::make_unique<buffer_pool>(static_cast<std::size_t>(vm["buffer_size"].as<int>()) * 1_MB,
+                                                     static_cast<std::size_t>(vm["buffer_memory_limit"].as<int>()) * 1_MB);
+
+            failed_ = false;
+            pipeline_depth_ = static_cast<std::size_t>(vm["pipeline_depth"].as<int>());
+            segment_size_ = static_cast<std::size_t>(vm["segment_size"].as<int>()) * 1_MB;
+            in_flight_segments_ = static_cast<std::size_t>(vm["in_flight_segments"].as<int>());
+            connection_pool_size_ = vm["connection_pool_size"].as<int>();
+            zero_copy_ = vm.count("zero_copy") > 0;
+            prefetch_ = vm.count("prefetch") > 0 || !vm["in_flight_segments"].defaulted();
+            io_depth_ = static_cast<std::size_t>(vm["io_depth"].as<int>());
+            chunk_size_ = static_cast<std::uintmax_t>(vm["chunk_size"].as<int>()) * 1_MB;
+
+            return ("-" == vm["physical_path"].as<std::string>())
+                ? get_to_stdout(env, vm)
+                : get_to_physical_path(env, vm);
+        }
+
+    private:
+        // Identifies a data object in the journal. The size and mtime are part of
+        // the key so that a data object modified between runs is downloaded again.
+        static auto journal_key(const ifs::path& _from, std::uintmax_t _object_size, std::time_t _mtime) -> std::string
+        {
+            return _from.string() + '|' + std::to_string(_object_size) + '|' + std::to_string(_mtime);
+        }
+
+        static auto journal_key(rcComm_t& _comm, const ifs::path& _from) -> std::string
+        {
+            return journal_key(_from,
+                               ifs::client::data_object_size(_comm, _from),
+                               ifs::client::last_write_time(_comm, _from).time_since_epoch().count());
+        }
+
+        auto get_to_stdout(const rodsEnv& _env, const po::variables_map& _vm) -> int
+        {
+            const auto logical_path = _vm["logical_path"].as<std::string>();
+
+            try {
+                std::optional<transfer_session> own_session;
+                auto& session = session_for(_env, connection_pool_size_, own_session);
+                auto conn = session.acquire();
+
+                if (!ifs::client::is_data_object(conn, logical_path)) {
+                    std::cerr << "Error: Logical path does not point to a data object.\n";
+                    return 1;
+                }
+
+                // With --resume or --journal, every block written to stdout is
+                // recorded in the journal. With --resume, the download restarts after
+                // the last recorded block that is also present in the output file.
+                //
+                // Resuming requires stdout to be a regular file that can be written
+                // at any offset, e.g. "irods get --resume <path> - 1<>file". A file
+                // opened with >> ignores the offset and would be corrupted, and one
+                // opened with > is truncated before the download starts.
+                const auto object_size = ifs::client::data_object_size(conn, logical_path);
+                const auto key = journal_key(logical_path,
+                                             object_size,
+                                             ifs::client::last_write_time(conn, logical_path).time_since_epoch().count());
+                const auto resume = _vm.count("resume") > 0;
+                std::optional<transfer_journal> journal;
+                std::uintmax_t offset = 0;
+
+                if (resume || _vm.count("journal")) {
+                    struct stat st;
+                    const auto is_file = fstat(STDOUT_FILENO, &st) == 0 && S_ISREG(st.st_mode);
+
+                    if (resume && !is_file) {
+                        std::cerr << "Error: --resume requires stdout to be redirected to a regular file (e.g. 1<>file).\n";
+                        return 1;
+                    }
+
+                    if (is_file && (fcntl(STDOUT_FILENO, F_GETFL) & O_APPEND)) {
+                        std::cerr << "Error: Cannot journal a download to stdout opened for appending. Use 1<>file instead of >>file.\n";
+                        return 1;
+                    }
+
+                    // Stdout cannot be resumed unless it is a regular file, so there is
+                    // nothing to journal.
+                    if (is_file) {
+                        const auto journal_path = _vm.count("journal")
+                            ? fs::path{_vm["journal"].as<std::string>()}
+                            : transfer_journal::default_path("get", key);
+                        journal.emplace(journal_path, resume);
+                    }
+
+                    if (resume) {
+                        offset = std::min<std::uintmax_t>(journal->completed_prefix(key), st.st_size);
+
+                        if (lseek(STDOUT_FILENO, static_cast<off_t>(offset), SEEK_SET) < 0) {
+                            std::cerr << "Error: Could not seek in output file.\n";
+                            return 1;
+                        }
+                    }
+                }
+
+                // With --prefetch (or --in_flight_segments), objects larger than a
+                // segment are fetched over several connections at once and
+                // reassembled in order. Otherwise a single stream is used.
+                if (prefetch_ && connection_pool_size_ > 1 && object_size > offset + segment_size_) {
+                    conn.release();
+
+                    if (!get_to_stdout_prefetched(session, logical_path, journal ? &*journal : nullptr, key, offset, object_size)) {
+                        return 1;
+                    }
+
+                    if (journal) {
+                        journal->remove();
+                    }
+
+                    return 0;
+                }
+
+                io::client::default_transport dtp{conn};
+
+                if (io::idstream in{dtp, logical_path}; in) {
+                    if (offset > 0 && !in.seekg(offset)) {
+                        std::cerr << "Error: Could not seek in input stream [path => " << logical_path << "]\n";
+                        return 1;
+                    }
+
+                    // With --zero_copy and a pipe as stdout, blocks are spliced into the
+                    // pipe instead of copied. The last block spliced is held back from
+                    // the reader, because the pipe may still reference its pages until
+                    // the next one has been spliced behind it.
+                    const auto splice = zero_copy_ && buffers_->max_buffers() > 1 &&
+                                        is_spliceable_pipe(STDOUT_FILENO, buffers_->buffer_size());
+
+                    if (splice && !std::cout.flush()) {
+                        throw std::runtime_error{"Could not write to stdout."};
+                    }
 
-            if (!fs::is_data_object(conn_pool.get_connection(), logical_path)) {
-                std::cerr << "Error: Logical path does not point to a data object.\n";
+                    // The next block is fetched from the server while the previous one
+                    // is being written to stdout.
+                    try {
+                        run_pipeline(
+                            *buffers_,
+                            pipeline_depth_,
+                            [&in, &logical_path](char* _data, std::size_t _size) -> std::size_t {
+                                in.read(_data, static_cast<std::streamsize>(_size));
+
+                                if (in.bad()) {
+                                    throw std::runtime_error{"Could not read from input stream [path => " + logical_path + "]"};
+                                }
+
+                                return static_cast<std::size_t>(in.gcount());
+                            },
+                            [&journal, &key, &offset, splice](const char* _data, std::size_t _size) {
+                                if (_size == 0) {
+                                    return;
+                                }
+
+                                if (splice) {
+                                    splice_to_pipe(STDOUT_FILENO, _data, _size);
+                                }
+                                else if (!std::cout.write(_data, static_cast<std::streamsize>(_size)).flush()) {
+                                    throw std::runtime_error{"Could not write to stdout."};
+                                }
+
+                                if (journal) {
+                                    journal->mark_range_complete(key, {offset, _size});
+                                }
+
+                                offset += _size;
+                            },
+                            splice ? 1 : 0);
+                    }
+                    catch (...) {
+                        if (splice) {
+                            wait_for_pipe_drain(STDOUT_FILENO);
+                        }
+
+                        throw;
+                    }
+
+                    if (splice) {
+                        wait_for_pipe_drain(STDOUT_FILENO);
+                    }
+
+                    if (journal) {
+                        journal->remove();
+                    }
+                }
+                else {
+                    std::cerr << "Error: Could not open input stream [path => " << logical_path << "]\n";
+                }
+            }
+            catch (const std::exception& e) {
+                std::cerr << "Error: " << e.what() << '\n';
                 return 1;
             }
 
-            auto conn = conn_pool.get_connection();
-            io::client::default_transport dtp{conn};
+            return 0;
+        }
 
-            if (io::idstream in{dtp, logical_path}; in) {
-                std::array<char, 4 * 1024 * 1024> buffer{};
+        // A segment of the data object waiting to be written to stdout.
+        struct segment
+        {
+            buffer_pool::buffer buffer;
+            std::size_t size;
+        }; // struct segment
+
+        // The reorder window shared by the prefetch workers and the writer.
+        // Segments are claimed in order but may complete in any order; the writer
+        // emits them strictly in sequence.
+        struct prefetch_window
+        {
+            std::map<std::uintmax_t, segment> ready;
+            std::uintmax_t next_index = 0;
+            std::uintmax_t emitted = 0;
+            bool failed = false;
+            std::mutex mtx;
+            std::condition_variable cv;
+        }; // struct prefetch_window
+
+        // Streams a data object to stdout with several segments in flight on
+        // separate connections. A worker may only claim a segment that lies
+        // within the window of segments following the last one written, so at
+        // most that many segments are buffered, no matter how far the writer
+        // falls behind (e.g. when the consumer of the pipe is slow).
+        //
+        // With --zero_copy and a pipe as stdout, segments are spliced into the
+        // pipe instead of copied. The last spliced segment is held back from
+        // the pool until the next one has been spliced behind it, because the
+        // pipe may still reference its pages.
+        //
+        // Written segments are recorded in _journal, if there is one.
+        auto get_to_stdout_prefetched(transfer_session& _session,
+                                      const ifs::path& _from,
+                                      transfer_journal* _journal,
+                                      const std::string& _key,
+                                      std::uintmax_t _offset,
+                                      std::uintmax_t _object_size) -> bool
+        {
+            const auto segment_count = (_object_size - _offset + segment_size_ - 1) / segment_size_;
+            const auto splice = zero_copy_ && is_spliceable_pipe(STDOUT_FILENO, segment_size_);
+            const auto held_segments = splice ? 1 : 0;
+            buffer_pool segments{segment_size_, segment_size_ * (in_flight_segments_ + held_segments)};
+            prefetch_window window;
+            buffer_pool::buffer spliced;
 
-                while (in && std::cout) {
-                    in.read(&buffer[0], buffer.size());
-                    std::cout.write(&buffer[0], in.gcount());
+            if (splice && !std::cout.flush()) {
+                throw std::runtime_error{"Could not write to stdout."};
+            }
+
+            const auto fail = [&window] {
+                {
+                    std::lock_guard lk{window.mtx};
+                    window.failed = true;
                 }
+
+                window.cv.notify_all();
+            };
+
+            irods::thread_pool workers{connection_pool_size_};
+
+            for (int i = 0; i < connection_pool_size_; ++i) {
+                irods::thread_pool::post(workers, [&, segment_count] {
+                    try {
+                        transfer_session::connection conn;
+                        std::optional<io::client::default_transport> tp;
+                        io::idstream in;
+
+                        while (true) {
+                            std::uintmax_t index = 0;
+
+                            {
+                                std::unique_lock lk{window.mtx};
+                                window.cv.wait(lk, [&] {
+                                    return window.failed || window.next_index == segment_count ||
+                                           window.next_index < window.emitted + in_flight_segments_;
+                                });
+
+                                if (window.failed || window.next_index == segment_count) {
+                                    return;
+                                }
+
+                                index = window.next_index++;
+                            }
+
+                            // Never blocks: the window admits no more segments than the
+                            // pool has buffers.
+                            auto b = segments.acquire();
+
+                            if (!conn) {
+                                conn = _session.acquire();
+                                tp.emplace(conn);
+                                in.open(*tp, _from);
+
+                                if (!in) {
+                                    throw std::runtime_error{"Cannot open data object for reading [path: " + _from.string() + "]."};
+                                }
+                            }
+
+                            const auto offset = _offset + index * segment_size_;
+                            const auto size = static_cast<std::size_t>(std::min<std::uintmax_t>(segment_size_, _object_size - offset));
+
+                            if (!in.seekg(offset) || !in.read(b.data(), static_cast<std::streamsize>(size))) {
+                                throw std::runtime_error{"Cannot read data object [path: " + _from.string() + "]."};
+                            }
+
+                            {
+                                std::lock_guard lk{window.mtx};
+                                window.ready.emplace(index, segment{std::move(b), size});
+                            }
+
+                            window.cv.notify_all();
+                        }
+                    }
+                    catch (const std::exception& e) {
+                        std::cerr << "Error: " << e.what() << '\n';
+                        fail();
+                    }
+                });
             }
-            else {
-                std::cerr << "Error: Could not open input stream [path => " << logical_path << "]\n";
+
+            try {
+                for (std::uintmax_t index = 0; index < segment_count; ++index) {
+                    segment seg;
+
+                    {
+                        std::unique_lock lk{window.mtx};
+                        window.cv.wait(lk, [&] { return window.failed || window.ready.count(index) > 0; });
+
+                        if (window.failed) {
+                            break;
+                        }
+
+                        auto node = window.ready.extract(index);
+                        seg = std::move(node.mapped());
+                    }
+
+                    if (splice) {
+                        splice_to_pipe(STDOUT_FILENO, seg.buffer.data(), seg.size);
+                        spliced = std::move(seg.buffer);
+                    }
+                    else if (!std::cout.write(seg.buffer.data(), static_cast<std::streamsize>(seg.size)).flush()) {
+                        throw std::runtime_error{"Could not write to stdout."};
+                    }
+
+                    if (_journal) {
+                        _journal->mark_range_complete(_key, {_offset + index * segment_size_, seg.size});
+                    }
+                    seg.buffer.release();
+
+                    {
+                        std::lock_guard lk{window.mtx};
+                        window.emitted = index + 1;
+                    }
+
+                    window.cv.notify_all();
+                }
+            }
+            catch (...) {
+                fail();
+                workers.join();
+
+                if (splice) {
+                    wait_for_pipe_drain(STDOUT_FILENO);
+                }
+
+                throw;
+            }
+
+            workers.join();
+
+            if (splice) {
+                wait_for_pipe_drain(STDOUT_FILENO);
+            }
+
+            return !window.failed;
+        }
+
+        auto get_to_physical_path(const rodsEnv& _env, const po::variables_map& _vm) -> int
+        {
+            try {
+                const ifs::path from = _vm["logical_path"].as<std::string>();
+                auto to = fs::path{_vm["physical_path"].as<std::string>()};
+
+                // Completed objects and ranges are recorded in the journal. With
+                // --resume, the records left behind by an interrupted run are used to
+                // skip work that has already been done.
+                const auto journal_path = _vm.count("journal")
+                    ? fs::path{_vm["journal"].as<std::string>()}
+                    : transfer_journal::default_path("get", from.string() + '\n' + fs::absolute(to).generic_string());
+                journal_ = std::make_unique<transfer_journal>(journal_path, _vm.count("resume") > 0);
+
+                // Every connection used by the command comes from this session.
+                std::optional<transfer_session> own_session;
+                auto& session = session_for(_env, connection_pool_size_, own_session);
+
+                const auto status = ifs::client::status(session.acquire(), from);
+
+                if (ifs::client::is_collection(status)) {
+                    if (_vm.count("recursive") == 0) {
+                        std::cerr << "Error: Logical path points to a collection. Use -r to download it.\n";
+                        return 1;
+                    }
+
+                    session.warm_up(connection_pool_size_);
+
+                    irods::thread_pool thread_pool{connection_pool_size_};
+                    get_collection(session, thread_pool, from, fs::is_directory(to) ? to / from.object_name().string() : to);
+                    thread_pool.join();
+                }
+                else if (ifs::client::is_data_object(status)) {
+                    if (fs::is_directory(to)) {
+                        to /= from.object_name().string();
+                    }
+
+                    irods::thread_pool thread_pool{connection_pool_size_};
+                    get_data_object(session, thread_pool, from, to);
+                    thread_pool.join();
+                }
+                else {
+                    std::cerr << "Error: Logical path must point to a data object or collection.\n";
+                    return 1;
+                }
+
+                if (failed_) {
+                    std::cerr << "Error: Some data objects could not be downloaded. Rerun with --resume to retry them.\n";
+                    return 1;
+                }
+
+                journal_->remove();
+            }
+            catch (const std::exception& e) {
+                std::cerr << "Error: " << e.what() << '\n';
+                return 1;
             }
 
             return 0;
         }
+
+        // Shared by every worker taking part in the download of a single large
+        // data object.
+        struct chunked_download
+        {
+            chunked_download(std::uintmax_t _object_size, std::uintmax_t _chunk_size, std::string _key, const fs::path& _to, bool _resume)
+                : scheduler{_object_size, _chunk_size}
+                , chunks_remaining{scheduler.chunk_count()}
+                , key{std::move(_key)}
+                , file{_to, _object_size, _resume}
+            {
+            }
+
+            chunk_scheduler scheduler;
+            std::uintmax_t chunks_remaining;
+            const std::string key;
+            local_file file;
+            std::unique_ptr<mapped_file> target;
+            std::atomic<bool> failed{false};
+            std::mutex mtx;
+            std::condition_variable cv;
+        }; // struct chunked_download
+
+        // Downloads ranges handed out by the scheduler until none remain and
+        // writes each one at its offset in the local file. The stream and the
+        // buffer are acquired once per worker, before any range is claimed, and
+        // the stream is repositioned for every range. Every range claimed by a
+        // worker is accounted for, even on failure, so that the owner of the
+        // download is never left waiting. A failure poisons the connection.
+        auto get_data_object_chunks(transfer_session::connection& _conn, chunked_download& _download, const ifs::path& _from) -> void
+        {
+            const auto finish_chunk = [&_download] {
+                std::lock_guard lk{_download.mtx};
+
+                if (--_download.chunks_remaining == 0) {
+                    _download.cv.notify_all();
+                }
+            };
+
+            io::client::default_transport tp{_conn};
+            io::idstream in;
+            auto bufs = _download.target ? std::vector<buffer_pool::buffer>{} : buffers_->acquire_batch(io_depth_);
+            local_io_engine engine{bufs};
+
+            while (const auto range = _download.scheduler.next()) {
+                try {
+                    if (_download.failed || journal_->is_range_complete(_download.key, *range)) {
+                        finish_chunk();
+                        continue;
+                    }
+
+                    if (!in.is_open()) {
+                        in.open(tp, _from);
+
+                        if (!in) {
+                            throw std::runtime_error{"Cannot open data object for reading [path: " + _from.string() + "]."};
+                        }
+                    }
+
+                    if (!in.seekg(range->offset)) {
+                        throw std::runtime_error{"Seek failed [path: " + _from.string() + "]."};
+                    }
+
+                    std::uintmax_t bytes_pulled = 0;
+
+                    if (_download.target) {
+                        in.read(_download.target->data() + range->offset, static_cast<std::streamsize>(range->size));
+                        bytes_pulled = static_cast<std::uintmax_t>(in.gcount());
+                    }
+                    else {
+                        // Local writes are queued behind the network reads, so the
+                        // disk is written while the next piece is received.
+                        const auto depth = engine.buffer_count();
+
+                        for (std::size_t i = 0; in && bytes_pulled < range->size; ++i) {
+                            const auto b = i % depth;
+
+                            if (engine.busy(b)) {
+                                engine.wait(b);
+                            }
+
+                            in.read(engine.buffer(b), std::min<std::uintmax_t>(buffers_->buffer_size(), range->size - bytes_pulled));
+
+                            if (in.gcount() > 0) {
+                                engine.queue_write(_download.file.fd(), b, in.gcount(), range->offset + bytes_pulled);
+                                engine.submit();
+                                bytes_pulled += in.gcount();
+                            }
+                        }
+
+                        // The range is only recorded once every piece is in the file.
+                        for (std::size_t b = 0; b < depth; ++b) {
+                            if (engine.busy(b)) {
+                                engine.wait(b);
+                            }
+                        }
+                    }
+
+                    if (bytes_pulled < range->size) {
+                        throw std::runtime_error{"Short transfer [path: " + _from.string() + "]."};
+                    }
+
+                    journal_->mark_range_complete(_download.key, *range);
+                    finish_chunk();
+                }
+                catch (const std::exception& e) {
+                    std::cerr << "Error: " << e.what() << '\n';
+                    _download.failed = true;
+                    _conn.poison();
+                    engine.drain();
+                    finish_chunk();
+                }
+            }
+        }
+
+        struct collection_object
+        {
+            ifs::path path;
+            fs::path local_path;
+            std::uintmax_t size;
+            std::time_t mtime;
+        }; // struct collection_object
+
+        // Downloads a collection tree into a local directory. The whole tree is
+        // listed with two queries, instead of one status call per entry, and its
+        // directories are created up front. The data objects are then sorted by
+        // size, largest first, and handed out one at a time to a fixed number of
+        // workers, so that at most one task per connection is ever queued and the
+        // largest objects are not left to run alone at the end of the job. Once
+        // the list runs dry, the idle threads pick up the queued range helpers of
+        // the large objects still in progress.
+        auto get_collection(transfer_session& _session,
+                            irods::thread_pool& _thread_pool,
+                            const ifs::path& _from,
+                            const fs::path& _to) -> void
+        {
+            const auto root = _from.string();
+            const auto prefix = root.back() == '/' ? root : root + '/';
+
+            // Rows are only trusted to name collections inside the tree being
+            // downloaded. Any other row, and any name with a "." or ".." in it,
+            // is skipped so that nothing is written outside of _to.
+            const auto to_local_path = [&root, &prefix, &_to](const std::string& _collection) -> std::optional<fs::path> {
+                if (_collection == root) {
+                    return _to;
+                }
+
+                if (_collection.compare(0, prefix.size(), prefix) != 0) {
+                    return std::nullopt;
+                }
+
+                const auto relative = _collection.substr(prefix.size());
+                const auto padded = '/' + relative + '/';
+
+                if (relative.empty() || padded.find("/../") != std::string::npos || padded.find("/./") != std::string::npos) {
+                    std::cerr << "Error: Skipping collection with an unsafe name [path: " << _collection << "].\n";
+                    return std::nullopt;
+                }
+
+                return _to / relative;
+            };
+
+            auto objects = std::make_shared<std::vector<collection_object>>();
+
+            {
+                auto conn = _session.acquire();
+
+                fs::create_directories(_to);
+
+                const auto pattern = escape_genquery_like(prefix) + '%';
+                const auto collections_gql = "select COLL_NAME where COLL_NAME like '" + pattern + "'";
+
+                for (auto&& row : irods::query<rcComm_t>{conn.get(), collections_gql}) {
+                    if (const auto local_path = to_local_path(row[0]); local_path) {
+                        fs::create_directories(*local_path);
+                    }
+                }
+
+                // Every good replica of a data object produces a row. Replicas share
+                // the name, so the object is only scheduled once.
+                const auto objects_gql = "select COLL_NAME, DATA_NAME, DATA_SIZE, DATA_MODIFY_TIME "
+                                         "where COLL_NAME = '" + genquery_literal(root) + "' || like '" + pattern + "' "
+                                         "and DATA_REPL_STATUS = '1'";
+                std::string last_path;
+
+                for (auto&& row : irods::query<rcComm_t>{conn.get(), objects_gql}) {
+                    const auto path = ifs::path{row[0]} / row[1];
+
+                    if (path.string() == last_path) {
+                        continue;
+                    }
+
+                    last_path = path.string();
+                    const auto local_path = to_local_path(row[0]);
+
+                    if (!local_path || row[1] == "." || row[1] == "..") {
+                        continue;
+                    }
+
+                    objects->push_back({path,
+                                        *local_path / row[1],
+                                        std::stoull(row[2]),
+                                        static_cast<std::time_t>(std::stoll(row[3]))});
+                }
+            }
+
+            std::sort(std::begin(*objects), std::end(*objects), [](const auto& _lhs, const auto& _rhs) {
+                return _lhs.size > _rhs.size;
+            });
+
+            auto next = std::make_shared<std::atomic<std::size_t>>(0);
+
+            for (int i = 0; i < connection_pool_size_; ++i) {
+                irods::thread_pool::post(_thread_pool, [this, &_session, &_thread_pool, objects, next] {
+                    for (auto n = (*next)++; n < objects->size(); n = (*next)++) {
+                        const auto& o = (*objects)[n];
+                        get_data_object(_session, _thread_pool, o.path, o.local_path, o.size, journal_key(o.path, o.size, o.mtime));
+                    }
+                });
+            }
+        }
+
+        auto get_data_object(transfer_session& _session,
+                             irods::thread_pool& _thread_pool,
+                             const ifs::path& _from,
+                             const fs::path& _to) -> void
+        {
+            try {
+                auto conn = _session.acquire();
+                const auto object_size = ifs::client::data_object_size(conn, _from);
+                const auto key = journal_key(conn, _from);
+                conn.release();
+
+                get_data_object(_session, _thread_pool, _from, _to, object_size, key);
+            }
+            catch (const std::exception& e) {
+                std::cerr << "Error: " << e.what() << '\n';
+                failed_ = true;
+            }
+        }
+
+        auto get_data_object(transfer_session& _session,
+                             irods::thread_pool& _thread_pool,
+                             const ifs::path& _from,
+                             const fs::path& _to,
+                             std::uintmax_t _object_size,
+                             const std::string& _key) -> void
+        {
+            try {
+                if (journal_->is_file_complete(_key)) {
+                    return;
+                }
+
+                auto conn = _session.acquire();
+
+                // If the data object's size is less than 32MB, then stream it over a
+                // single connection.
+                if (_object_size < 32_MB) {
+                    get_data_object(conn, _from, _to, _object_size);
+                    journal_->mark_file_complete(_key);
+                    return;
+                }
+
+                // The data object is cut into many ranges of the configured chunk
+                // size. The calling task downloads ranges itself and recruits helpers
+                // from the thread pool. Helpers only join while the session has a
+                // connection to spare, so the caller can never deadlock waiting on
+                // helpers that are stuck behind it in the queue.
+                //
+                // A partially downloaded file left behind by an interrupted run must
+                // not be truncated, or the ranges recorded in the journal would be
+                // lost.
+                auto download = std::make_shared<chunked_download>(_object_size, chunk_size_, _key, _to, journal_->has_ranges(_key));
+
+                // With --zero_copy, ranges are read from the stream straight into a
+                // mapping of the destination.
+                if (zero_copy_ && download->file.preallocated()) {
+                    download->target = std::make_unique<mapped_file>(_to.string(), download->file.fd(), _object_size);
+                }
+
+                const auto worker_count = chunk_scheduler::worker_count(_object_size, chunk_size_, _session.max_connections());
+
+                // The download starts on the connection at hand; helpers join as the
+                // others finish their handshakes.
+                _session.warm_up(worker_count);
+
+                for (int i = 1; i < worker_count; ++i) {
+                    irods::thread_pool::post(_thread_pool, [this, &_session, download, _from] {
+                        if (auto helper_conn = _session.try_acquire(); helper_conn) {
+                            get_data_object_chunks(helper_conn, *download, _from);
+                        }
+                    });
+                }
+
+                get_data_object_chunks(conn, *download, _from);
+
+                {
+                    std::unique_lock lk{download->mtx};
+                    download->cv.wait(lk, [&download] { return download->chunks_remaining == 0; });
+                }
+
+                if (download->failed) {
+                    failed_ = true;
+                    return;
+                }
+
+                journal_->mark_file_complete(_key);
+            }
+            catch (const std::exception& e) {
+                std::cerr << "Error: " << e.what() << '\n';
+                failed_ = true;
+            }
+        }
+
+        // Streams a data object into a local file over a single connection.
+        auto get_data_object(rcComm_t& _comm, const ifs::path& _from, const fs::path& _to, std::uintmax_t _object_size)
+            -> void
+        {
+            local_file file{_to, _object_size, false};
+
+            if (_object_size == 0) {
+                return;
+            }
+
+            io::client::default_transport tp{_comm};
+            io::idstream in{tp, _from};
+
+            if (!in) {
+                throw std::runtime_error{"Cannot open data object for reading [path: " + _from.string() + "]."};
+            }
+
+            if (zero_copy_ && file.preallocated()) {
+                const mapped_file target{_to.string(), file.fd(), _object_size};
+
+                if (!in.read(target.data(), static_cast<std::streamsize>(target.size()))) {
+                    throw std::runtime_error{"Short transfer [path: " + _from.string() + "]."};
+                }
+
+                return;
+            }
+
+            std::uintmax_t offset = 0;
+
+            run_pipeline(
+                *buffers_,
+                pipeline_depth_,
+                [&in, &_from](char* _data, std::size_t _size) -> std::size_t {
+                    in.read(_data, static_cast<std::streamsize>(_size));
+
+                    if (in.bad()) {
+                        throw std::runtime_error{"Cannot read data object [path: " + _from.string() + "]."};
+                    }
+
+                    return static_cast<std::size_t>(in.gcount());
+                },
+                [&file, &offset](const char* _data, std::size_t _size) {
+                    file.write_at(offset, _data, _size);
+                    offset += _size;
+                });
+
+            if (offset < _object_size) {
+                throw std::runtime_error{"Short transfer [path: " + _from.string() + "]."};
+            }
+        }
+
+        std::unique_ptr<buffer_pool> buffers_;
+        std::unique_ptr<transfer_journal> journal_;
+        std::atomic<bool> failed_{false};
+        std::size_t pipeline_depth_ = 2;
+        std::size_t segment_size_ = 8_MB;
+        std::size_t in_flight_segments_ = 8;
+        bool zero_copy_ = false;
+        bool prefetch_ = false;
+        std::size_t io_depth_ = 4;
+        int connection_pool_size_ = 4;
+        std::uintmax_t chunk_size_ = 32_MB;
     }; // class get
 } // namespace irods::cli
 
-// TODO Need to investigate whether this is truely required.
-//extern "C" BOOST_SYMBOL_EXPORT irods::cli::get cli_impl;
-irods::cli::get cli_impl;
-
+IRODS_CLI_COMMAND(get)
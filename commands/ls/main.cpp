@@ -1,23 +1,35 @@
 #include "command.hpp"
+#include "tar_archive.hpp"
+#include "collection_listing.hpp"
+#include "transfer_session.hpp"
+#include "tree_walker.hpp"
+#include "listing_formatter.hpp"
+#include "metadata_cache.hpp"
+#include "listing_sort.hpp"
 
 #include <irods/rodsClient.h>
-#include <irods/connection_pool.hpp>
 #include <irods/filesystem.hpp>
+#include <irods/dstream.hpp>
+#include <irods/transport/default_transport.hpp>
 
 #include <boost/config.hpp>
 #include <boost/program_options.hpp>
 
 #include <fmt/format.h>
 
+#include <unistd.h>
+
+#include <algorithm>
 #include <iostream>
+#include <iterator>
+#include <optional>
 #include <string>
 #include <chrono>
 #include <vector>
-#include <iomanip>
 #include <ctime>
-#include <sstream>
 
 namespace fs = irods::experimental::filesystem;
+namespace io = irods::experimental::io;
 namespace po = boost::program_options;
 
 namespace irods::cli
@@ -48,8 +60,15 @@ namespace irods::cli
                 ("l,l", "")
                 ("L,L", "")
                 ("r,r", "")
-                ("t,t", po::value<std::string>(), "")
+                ("t,t", "")
                 ("bundle", "")
+                ("connection_pool_size,c", po::value<int>()->default_value(4), "")
+                ("unordered", "")
+                ("format", po::value<std::string>()->default_value("text"), "")
+                ("sort", po::value<std::string>(), "")
+                ("reverse", "")
+                ("head", po::value<int>(), "")
+                ("sort_memory_limit", po::value<int>()->default_value(256), "")
                 ("logical_path", po::value<std::string>(), "");
 
             po::positional_options_description positional_options;
@@ -59,6 +78,67 @@ namespace irods::cli
             po::store(po::command_line_parser(args).options(options).positional(positional_options).run(), vm);
             po::notify(vm);
 
+            if (vm["connection_pool_size"].as<int>() < 1) {
+                std::cerr << "Error: Connection pool size must be greater than zero.\n";
+                return 1;
+            }
+
+            listing_format format;
+
+            if (const auto& f = vm["format"].as<std::string>(); f == "text") {
+                format = listing_format::text;
+            }
+            else if (f == "jsonl") {
+                format = listing_format::jsonl;
+            }
+            else if (f == "binary") {
+                format = listing_format::binary;
+            }
+            else {
+                std::cerr << "Error: Output format must be one of text, jsonl, or binary.\n";
+                return 1;
+            }
+
+            sort_options sort;
+
+            // -t is short for --sort time.
+            if (const auto k = vm.count("sort") ? vm["sort"].as<std::string>() : (vm.count("t") ? "time" : ""); k == "name") {
+                sort.key = sort_key::name;
+            }
+            else if (k == "size") {
+                sort.key = sort_key::size;
+            }
+            else if (k == "time") {
+                sort.key = sort_key::time;
+            }
+            else if (!k.empty()) {
+                std::cerr << "Error: Sort key must be one of name, size, or time.\n";
+                return 1;
+            }
+
+            sort.reverse = vm.count("reverse") > 0;
+
+            if (vm.count("head")) {
+                if (vm["head"].as<int>() < 0) {
+                    std::cerr << "Error: Head must not be negative.\n";
+                    return 1;
+                }
+
+                sort.head = static_cast<std::size_t>(vm["head"].as<int>());
+            }
+
+            if (vm["sort_memory_limit"].as<int>() < 1) {
+                std::cerr << "Error: Sort memory limit must be greater than zero.\n";
+                return 1;
+            }
+
+            sort.memory_limit = static_cast<std::size_t>(vm["sort_memory_limit"].as<int>()) * 1024 * 1024;
+
+            // Machine-readable formats and sorting only exist for long listings.
+            const auto long_listing = vm.count("l") || vm.count("L") || format != listing_format::text ||
+                                      sort.key != sort_key::none || vm.count("head");
+            const auto detail = vm.count("L") ? listing_detail::full : listing_detail::basic;
+
             rodsEnv env;
 
             if (getRodsEnv(&env) < 0) {
@@ -67,42 +147,38 @@ namespace irods::cli
             }
 
             const auto logical_path = vm.count("logical_path") ? vm["logical_path"].as<std::string>() : env.rodsCwd;
-            auto conn_pool = irods::make_connection_pool();
-            auto conn = conn_pool->get_connection();
+            std::optional<transfer_session> own_session;
+            auto& session = session_for(env, vm["connection_pool_size"].as<int>(), own_session);
+            auto conn = session.acquire();
+            const auto cache = metadata_cache::open(env);
 
-            if (const auto s = fs::client::status(conn, logical_path); fs::client::is_collection(s)) {
-                if (vm.count("l")) {
-                    if (vm.count("r")) {
-                        for (auto&& e : fs::client::recursive_collection_iterator{conn, logical_path}) {
-                            print_one_liner_description(conn, e);
-                        }
-                    }
-                    else {
-                        for (auto&& e : fs::client::collection_iterator{conn, logical_path}) {
-                            print_one_liner_description(conn, e);
-                        }
-                    }
-                }
-                else if (vm.count("L")) {
+            if (const auto kind = object_kind_of(cache.get(), conn, logical_path); kind == object_kind::collection) {
+                if (long_listing) {
                     if (vm.count("r")) {
-                        for (auto&& e : fs::client::recursive_collection_iterator{conn, logical_path}) {
-                            print_multi_line_description(e);
-                        }
-                    }
-                    else {
-                        for (auto&& e : fs::client::collection_iterator{conn, logical_path}) {
-                            print_multi_line_description(e);
-                        }
+                        const auto order = vm.count("unordered") ? walk_order::unordered : walk_order::ordered;
+
+                        // The walk takes its connections from the same session.
+                        conn.release();
+
+                        return print_long_listing_recursive(session, logical_path, order, detail, format, cache.get(), sort);
                     }
+
+                    listing_formatter formatter{detail, format};
+
+                    return print_long_listing(conn, logical_path, formatter, cache.get(), sort);
                 }
             }
-            else if (fs::client::is_data_object(s)) {
-                if (vm.count("l")) {
-
+            else if (kind == object_kind::data_object) {
+                if (vm.count("bundle")) {
+                    return print_bundle_contents(conn, logical_path, vm.count("l") > 0);
                 }
-                else if (vm.count("L")) {
 
+                if (long_listing) {
+                    listing_formatter formatter{detail, format};
+                    return print_data_object(conn, logical_path, formatter);
                 }
+
+                fmt::print("{}\n", logical_path);
             }
             else {
                 std::cerr << "Error: Logical path does not point to a collection or data object.\n";
@@ -113,29 +189,266 @@ namespace irods::cli
         }
 
     private:
-        auto print_one_liner_description(rcComm_t& conn, const fs::collection_entry& e) -> void
+        // Lists the collection tree with one worker per connection. Collections
+        // are fanned out across the connections, and their listings are printed
+        // in depth-first order unless --unordered is given. Sorting and --head
+        // apply to each collection separately, and the workers share the sort
+        // memory limit.
+        auto print_long_listing_recursive(transfer_session& session,
+                                          const fs::path& p,
+                                          walk_order order,
+                                          listing_detail detail,
+                                          listing_format format,
+                                          metadata_cache* cache,
+                                          sort_options sort) -> int
+        {
+            try {
+                sort.memory_limit /= static_cast<std::size_t>(session.max_connections());
+                block_writer out{STDOUT_FILENO};
+                const auto root = p.string();
+
+                tree_walker{session}.walk(
+                    root,
+                    order,
+                    [&root, detail, format, cache, &sort](rcComm_t& conn, const std::string& c, std::string& output) {
+                        // One formatter and buffer per collection; rows are appended
+                        // without further allocations once the buffer has grown.
+                        listing_formatter formatter{detail, format};
+                        fmt::memory_buffer buf;
+
+                        if (c != root) {
+                            formatter.header(buf, c);
+                        }
+
+                        auto subcollections = format_long_listing(conn, c, formatter, buf, cache, sort);
+                        output.assign(buf.data(), buf.size());
+
+                        return subcollections;
+                    },
+                    [&out](const std::string& output) {
+                        out.append(output);
+                    });
+
+                out.flush();
+            }
+            catch (const std::exception& e) {
+                std::cerr << "Error: " << e.what() << '\n';
+                return 1;
+            }
+
+            return 0;
+        }
+
+        auto print_long_listing(rcComm_t& conn,
+                                const fs::path& p,
+                                listing_formatter& formatter,
+                                metadata_cache* cache,
+                                const sort_options& sort) -> int
+        {
+            try {
+                block_writer out{STDOUT_FILENO};
+                format_long_listing(conn, p, formatter, out.buffer(), cache, sort, [&out] { out.flush_if_full(); });
+                out.flush();
+            }
+            catch (const std::exception& e) {
+                std::cerr << "Error: " << e.what() << '\n';
+                return 1;
+            }
+
+            return 0;
+        }
+
+        auto print_data_object(rcComm_t& conn, const fs::path& p, listing_formatter& formatter) -> int
         {
-            auto tm = std::chrono::system_clock::to_time_t(e.last_write_time());
-            std::stringstream ss;
-            ss << std::put_time(std::localtime(&tm), "%F %T");
-
-            fmt::print("{:<10} {} {:<10} {:>15} {} & {}\n",
-                       e.owner(),
-                       0,
-                       "demoResc",
-                       fs::client::data_object_size(conn, e),
-                       ss.str(),
-                       e.path().object_name().c_str());
+            try {
+                block_writer out{STDOUT_FILENO};
+                const auto collection = p.parent_path().string();
+
+                for_each_replica_of(conn,
+                                    collection,
+                                    p.object_name().string(),
+                                    formatter.detail(),
+                                    [&collection, &formatter, &out](const replica_entry& e) {
+                                        formatter.replica(out.buffer(), collection, e);
+                                    });
+
+                out.flush();
+            }
+            catch (const std::exception& e) {
+                std::cerr << "Error: " << e.what() << '\n';
+                return 1;
+            }
+
+            return 0;
+        }
+
+        // Appends one record per replica, followed by the subcollections, to buf.
+        // Each collection costs two queries, however many entries it holds, or
+        // none if the listing is in the cache. Replicas are streamed in catalog
+        // order unless a sort key is given; subcollections are sorted by name then.
+        // _after_row is called after every row, e.g. to write out full blocks.
+        // Returns the subcollections, in the order they were printed.
+        template <typename Callback = void (*)()>
+        static auto format_long_listing(rcComm_t& conn,
+                                        const fs::path& p,
+                                        listing_formatter& formatter,
+                                        fmt::memory_buffer& buf,
+                                        metadata_cache* cache,
+                                        const sort_options& sort,
+                                        Callback _after_row = [] {}) -> std::vector<std::string>
+        {
+            const auto collection = p.string();
+            auto remaining = sort.head;
+
+            const auto print_replica = [&](const replica_entry& e) {
+                if (remaining > 0) {
+                    --remaining;
+                    formatter.replica(buf, collection, e);
+                    _after_row();
+                }
+            };
+
+            std::optional<listing_sorter> sorter;
+
+            if (sort.key != sort_key::none) {
+                sorter.emplace(sort);
+            }
+
+            const auto add_replica = [&](const replica_entry& e) {
+                if (sorter) {
+                    sorter->add(e);
+                }
+                else {
+                    print_replica(e);
+                }
+            };
+
+            const auto print_subcollections = [&](std::vector<std::string>& subcollections) {
+                if (sort.key != sort_key::none) {
+                    std::sort(subcollections.begin(), subcollections.end());
+
+                    if (sort.reverse) {
+                        std::reverse(subcollections.begin(), subcollections.end());
+                    }
+                }
+
+                for (auto&& c : subcollections) {
+                    if (remaining == 0) {
+                        break;
+                    }
+
+                    --remaining;
+                    formatter.collection(buf, c);
+                    _after_row();
+                }
+            };
+
+            if (cache) {
+                if (auto listing = cache->lookup_listing(collection, formatter.detail()); listing) {
+                    for (auto&& e : listing->replicas) {
+                        add_replica(e);
+                    }
+
+                    if (sorter) {
+                        sorter->for_each(print_replica);
+                    }
+
+                    print_subcollections(listing->subcollections);
+
+                    return std::move(listing->subcollections);
+                }
+            }
+
+            // Entries are only kept for the cache while the listing is small enough
+            // to be cached.
+            std::optional<cached_listing> listing;
+
+            // Anything invalidated while the catalog is queried may be missing from
+            // the result, which is then not cached.
+            const auto generation = cache ? cache->generation() : 0;
+
+            if (cache) {
+                listing.emplace();
+            }
+
+            const auto keep = [&listing] {
+                return listing && listing->replicas.size() + listing->subcollections.size() < metadata_cache::max_listing_entries;
+            };
+
+            for_each_replica(conn, collection, formatter.detail(), [&](const replica_entry& e) {
+                add_replica(e);
+
+                if (keep()) {
+                    listing->replicas.push_back(e);
+                }
+                else {
+                    listing.reset();
+                }
+            });
+
+            if (sorter) {
+                sorter->for_each(print_replica);
+            }
+
+            std::vector<std::string> subcollections;
+
+            for_each_subcollection(conn, collection, [&](const std::string& c) {
+                subcollections.push_back(c);
+            });
+
+            if (listing && keep()) {
+                listing->subcollections = subcollections;
+                cache->store_listing(collection, formatter.detail(), *listing, generation);
+            }
+
+            print_subcollections(subcollections);
+
+            return subcollections;
         }
 
-        auto print_multi_line_description(const fs::collection_entry& e) -> void
+        // Lists the members of a tar bundle (e.g. one written by "put --bundle").
+        // Only the headers are read; member contents are skipped on the server.
+        auto print_bundle_contents(rcComm_t& conn, const fs::path& p, bool long_format) -> int
         {
+            try {
+                io::client::default_transport tp{conn};
+                io::idstream in{tp, p};
+
+                if (!in) {
+                    std::cerr << "Error: Could not open input stream [path => " << p.string() << "]\n";
+                    return 1;
+                }
+
+                block_writer out{STDOUT_FILENO};
+                timestamp_cache timestamps;
+
+                tar::for_each_entry(in, [long_format, &out, &timestamps](const tar::entry& e) {
+                    if (long_format) {
+                        fmt::format_to(std::back_inserter(out.buffer()),
+                                       "{:04o} {:>15} {} {}\n",
+                                       e.mode & 07777,
+                                       e.size,
+                                       timestamps.format(e.mtime),
+                                       e.name);
+                    }
+                    else {
+                        fmt::format_to(std::back_inserter(out.buffer()), "{}\n", e.name);
+                    }
+
+                    out.flush_if_full();
+                });
+
+                out.flush();
+            }
+            catch (const std::exception& e) {
+                std::cerr << "Error: " << e.what() << '\n';
+                return 1;
+            }
 
+            return 0;
         }
     }; // class ls
 } // namespace irods::cli
 
-// TODO Need to investigate whether this is truely required.
-//extern "C" BOOST_SYMBOL_EXPORT irods::cli::touch cli_impl;
-irods::cli::ls cli_impl;
+IRODS_CLI_COMMAND(ls)
 
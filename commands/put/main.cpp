@@ -1,9 +1,18 @@
 #include "command.hpp"
+#include "chunk_scheduler.hpp"
+#include "buffer_pool.hpp"
+#include "transfer_session.hpp"
+#include "tar_archive.hpp"
+#include "transfer_journal.hpp"
+#include "catalog_snapshot.hpp"
+#include "checksum.hpp"
+#include "transfer_pipeline.hpp"
+#include "mapped_file.hpp"
+#include "local_io_engine.hpp"
+#include "metadata_cache.hpp"
 
 #include <irods/rodsClient.h>
 #include <irods/thread_pool.hpp>
-#include <irods/connection_pool.hpp>
-#include <irods/thread_pool.hpp>
 #include <irods/filesystem.hpp>
 #include <irods/dstream.hpp>
 #include <irods/transport/default_transport.hpp>
@@ -13,10 +22,13 @@
 #include <boost/program_options.hpp>
 #include <boost/filesystem.hpp>
 
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include <iostream>
 #include <string>
-#include <array>
 #include <vector>
+#include <deque>
 #include <memory>
 #include <fstream>
 #include <stdexcept>
@@ -24,7 +36,19 @@
 #include <thread>
 #include <mutex>
 #include <atomic>
+#include <condition_variable>
+#include <future>
 #include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <ctime>
+#include <utility>
+#include <optional>
+#include <cstdlib>
+#include <string_view>
+#include <random>
+#include <cstdio>
 
 // clang-format off
 namespace fs   = boost::filesystem;
@@ -40,6 +64,53 @@ namespace
     {
         return x * 1024 * 1024;
     }
+
+    // Returns the reader stage of a transfer pipeline. The input is hashed as
+    // it is read, which overlaps with the writer stage sending the previous
+    // block. Hashing only slows the transfer down when it is slower than the
+    // network.
+    auto read_stage(std::istream& _in, std::optional<irods::cli::sha256>& _hasher)
+    {
+        return [&_in, &_hasher](char* _data, std::size_t _size) -> std::size_t {
+            _in.read(_data, static_cast<std::streamsize>(_size));
+
+            if (_in.bad()) {
+                throw std::runtime_error{"Cannot read input."};
+            }
+
+            const auto n = static_cast<std::size_t>(_in.gcount());
+
+            if (_hasher) {
+                _hasher->update(_data, n);
+            }
+
+            return n;
+        };
+    }
+
+    // Returns true if _fd is a regular file with more than _size bytes left to
+    // read. Pipes and terminals are of unknown size.
+    auto has_more_than(int _fd, std::uintmax_t _size) -> bool
+    {
+        struct stat st;
+
+        if (::fstat(_fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+            return false;
+        }
+
+        const auto position = ::lseek(_fd, 0, SEEK_CUR);
+
+        return position >= 0 && st.st_size > position && static_cast<std::uintmax_t>(st.st_size - position) > _size;
+    }
+
+    auto write_stage(std::ostream& _out, const ifs::path& _path)
+    {
+        return [&_out, _path](const char* _data, std::size_t _size) {
+            if (!_out.write(_data, static_cast<std::streamsize>(_size))) {
+                throw std::runtime_error{"Cannot write data object [path: " + _path.string() + "]."};
+            }
+        };
+    }
 } // anonymous namespace
 
 namespace irods::cli
@@ -75,7 +146,24 @@ namespace irods::cli
             options.add_options()
                 ("physical_path", po::value<std::string>(), "")
                 ("logical_path", po::value<std::string>()->default_value(env.rodsHome), "")
-                ("connection_pool_size,c", po::value<int>()->default_value(4), "");
+                ("connection_pool_size,c", po::value<int>()->default_value(4), "")
+                ("chunk_size", po::value<int>()->default_value(32), "")
+                ("buffer_size", po::value<int>()->default_value(4), "")
+                ("buffer_memory_limit", po::value<int>()->default_value(256), "")
+                ("pipeline_depth", po::value<int>()->default_value(2), "")
+                ("segment_size", po::value<int>()->default_value(8), "")
+                ("in_flight_segments", po::value<int>()->default_value(8), "")
+                ("bundle", "")
+                ("bundle_size", po::value<int>()->default_value(256), "")
+                ("bundle_file_size_limit", po::value<int>()->default_value(1), "")
+                ("checksum", "")
+                ("sync", "")
+                ("sync_checksum", "")
+                ("resume", "")
+                ("journal", po::value<std::string>(), "")
+                ("zero_copy", "")
+                ("io_depth", po::value<int>()->default_value(4), "")
+                ("verbose,V", "");
 
             po::positional_options_description positional_options;
             positional_options.add("physical_path", 1);
@@ -90,13 +178,104 @@ namespace irods::cli
                 return 1;
             }
 
-            return ("-" == vm["physical_path"].as<std::string>())
-                ? put_from_stdin(env, vm["logical_path"].as<std::string>())
+            if (vm["connection_pool_size"].as<int>() < 1) {
+                std::cerr << "Error: Connection pool size must be greater than zero.\n";
+                return 1;
+            }
+
+            if (vm["chunk_size"].as<int>() < 1) {
+                std::cerr << "Error: Chunk size must be greater than zero.\n";
+                return 1;
+            }
+
+            if (vm["buffer_size"].as<int>() < 1) {
+                std::cerr << "Error: Buffer size must be greater than zero.\n";
+                return 1;
+            }
+
+            if (vm["buffer_memory_limit"].as<int>() < vm["buffer_size"].as<int>()) {
+                std::cerr << "Error: Buffer memory limit must be at least as large as the buffer size.\n";
+                return 1;
+            }
+
+            buffers_ = std::make_unique<buffer_pool>(static_cast<std::size_t>(vm["buffer_size"].as<int>()) * 1_MB,
+                                                     static_cast<std::size_t>(vm["buffer_memory_limit"].as<int>()) * 1_MB);
+
+            if (vm["pipeline_depth"].as<int>() < 1) {
+                std::cerr << "Error: Pipeline depth must be greater than zero.\n";
+                return 1;
+            }
+
+            if (vm["io_depth"].as<int>() < 1) {
+                std::cerr << "Error: I/O depth must be greater than zero.\n";
+                return 1;
+            }
+
+            if (vm["segment_size"].as<int>() < 1 || vm["in_flight_segments"].as<int>() < 1) {
+                std::cerr << "Error: Segment size and in-flight segments must be greater than zero.\n";
+                return 1;
+            }
+
+            if (vm["bundle_size"].as<int>() < 1 || vm["bundle_file_size_limit"].as<int>() < 1) {
+                std::cerr << "Error: Bundle sizes must be greater than zero.\n";
+                return 1;
+            }
+
+            failed_ = false;
+            pipeline_depth_ = static_cast<std::size_t>(vm["pipeline_depth"].as<int>());
+            segment_size_ = static_cast<std::size_t>(vm["segment_size"].as<int>()) * 1_MB;
+            in_flight_segments_ = static_cast<std::size_t>(vm["in_flight_segments"].as<int>());
+            checksum_ = vm.count("checksum") > 0;
+            sync_ = vm.count("sync") > 0;
+            sync_checksum_ = vm.count("sync_checksum") > 0;
+            zero_copy_ = vm.count("zero_copy") > 0;
+            io_depth_ = static_cast<std::size_t>(vm["io_depth"].as<int>());
+            connection_pool_size_ = vm["connection_pool_size"].as<int>();
+            chunk_size_ = static_cast<std::uintmax_t>(vm["chunk_size"].as<int>()) * 1_MB;
+
+            if ("-" == vm["physical_path"].as<std::string>() && vm.count("resume")) {
+                std::cerr << "Error: --resume is not supported when reading from stdin.\n";
+                return 1;
+            }
+
+            const auto ec = ("-" == vm["physical_path"].as<std::string>())
+                ? put_from_stdin(env,
+                                 vm["logical_path"].as<std::string>(),
+                                 !vm["connection_pool_size"].defaulted() || !vm["segment_size"].defaulted() ||
+                                     !vm["in_flight_segments"].defaulted())
                 : put_from_physical_path(env, vm);
+
+            // Failed uploads may have created data objects too.
+            if (const auto cache = metadata_cache::open(env); cache) {
+                invalidate_destination(*cache, vm);
+            }
+
+            return ec;
         }
 
     private:
-        auto put_from_stdin(const rodsEnv& _env, const std::string& _logical_path) -> int
+        static auto invalidate_destination(metadata_cache& _cache, const po::variables_map& _vm) -> void
+        {
+            const auto& from = _vm["physical_path"].as<std::string>();
+            const ifs::path to = _vm["logical_path"].as<std::string>();
+
+            if ("-" == from) {
+                _cache.invalidate(to.string());
+            }
+            else if (fs::is_regular_file(from)) {
+                _cache.invalidate((to / fs::path{from}.filename().string()).string());
+            }
+            else {
+                _cache.clear();
+            }
+        }
+
+        // Segments are only uploaded over several connections when asked for
+        // with -c, --segment_size or --in_flight_segments (_segments_requested),
+        // or when stdin is a file larger than a segment. Otherwise the extra
+        // handshakes and out-of-order writes cost more than they save on the
+        // small inputs typical of pipes.
+        auto put_from_stdin(const rodsEnv& _env, const std::string& _logical_path, bool _segments_requested) -> int
         {
             if (_logical_path.empty()) {
                 std::cerr << "Error: The logical path is empty.\n";
@@ -104,29 +283,40 @@ namespace irods::cli
             }
 
             try {
-                irods::connection_pool conn_pool{1, _env.rodsHost, _env.rodsPort, _env.rodsUserName, _env.rodsZone, 600};
+                std::optional<transfer_session> own_session;
+                auto& session = session_for(_env, connection_pool_size_, own_session);
 
-                auto conn = conn_pool.get_connection();
+                auto conn = session.acquire();
 
                 if (ifs::client::exists(conn, _logical_path) && !ifs::client::is_data_object(conn, _logical_path)) {
                     std::cerr << "Error: The logical path points to something other than a data object.\n";
                     return 1;
                 }
 
+                if (connection_pool_size_ > 1 && (_segments_requested || has_more_than(STDIN_FILENO, segment_size_))) {
+                    conn.release();
+                    return put_from_stdin_in_segments(session, _logical_path);
+                }
+
                 io::client::default_transport tp{conn};
 
-                if (io::odstream out{tp, _logical_path}; out) {
-                    std::array<char, 4_MB> buffer{};
+                std::optional<sha256> hasher;
 
-                    while (std::cin && out) {
-                        std::cin.read(&buffer[0], buffer.size());
-                        out.write(&buffer[0], std::cin.gcount());
-                    }
+                if (checksum_) {
+                    hasher.emplace();
+                }
+
+                if (io::odstream out{tp, _logical_path}; out) {
+                    run_pipeline(*buffers_, pipeline_depth_, read_stage(std::cin, hasher), write_stage(out, _logical_path));
                 }
                 else {
                     std::cerr << "Error: Could not open output stream [path => " << _logical_path << "].\n";
                     return 1;
                 }
+
+                if (hasher) {
+                    verify_checksum(conn, _logical_path, hasher->final());
+                }
             }
             catch (const std::exception& e) {
                 std::cerr << "Error: " << e.what() << '\n';
@@ -136,26 +326,233 @@ namespace irods::cli
             return 0;
         }
 
+        // A segment of stdin waiting to be written at its offset.
+        struct segment
+        {
+            std::uintmax_t offset;
+            buffer_pool::buffer buffer;
+            std::size_t size;
+        }; // struct segment
+
+        // Hands segments from the stdin reader to the upload workers.
+        struct segment_queue
+        {
+            std::deque<segment> segments;
+            bool closed = false;
+            std::atomic<bool> failed{false};
+            std::mutex mtx;
+            std::condition_variable cv;
+        }; // struct segment_queue
+
+        // Slices stdin into fixed-size sequential segments and writes them at
+        // their offsets concurrently over the session's connections. Memory is
+        // bounded by the segment pool: the reader blocks once the configured
+        // number of segments is in flight. Connections are only opened by workers
+        // that actually receive a segment, so short inputs use one connection.
+        auto put_from_stdin_in_segments(transfer_session& _session, const std::string& _logical_path) -> int
+        {
+            {
+                auto conn = _session.acquire();
+                io::client::default_transport tp{conn};
+
+                if (!io::odstream{tp, _logical_path}) {
+                    std::cerr << "Error: Could not open output stream [path => " << _logical_path << "].\n";
+                    return 1;
+                }
+            }
+
+            buffer_pool segments{segment_size_, segment_size_ * in_flight_segments_};
+            segment_queue queue;
+            std::optional<sha256> hasher;
+
+            if (checksum_) {
+                hasher.emplace();
+            }
+
+            irods::thread_pool workers{connection_pool_size_};
+
+            for (int i = 0; i < connection_pool_size_; ++i) {
+                irods::thread_pool::post(workers, [this, &_session, &queue, &_logical_path] {
+                    put_segments(_session, queue, _logical_path);
+                });
+            }
+
+            const auto close_queue = [&queue] {
+                {
+                    std::lock_guard lk{queue.mtx};
+                    queue.closed = true;
+                }
+
+                queue.cv.notify_all();
+            };
+
+            try {
+                std::uintmax_t offset = 0;
+
+                while (!queue.failed) {
+                    auto b = segments.acquire();
+                    std::cin.read(b.data(), static_cast<std::streamsize>(b.size()));
+
+                    if (std::cin.bad()) {
+                        throw std::runtime_error{"Cannot read from stdin."};
+                    }
+
+                    const auto n = static_cast<std::size_t>(std::cin.gcount());
+
+                    if (n == 0) {
+                        break;
+                    }
+
+                    if (hasher) {
+                        hasher->update(b.data(), n);
+                    }
+
+                    {
+                        std::lock_guard lk{queue.mtx};
+                        queue.segments.push_back({offset, std::move(b), n});
+                    }
+
+                    queue.cv.notify_one();
+                    offset += n;
+
+                    if (n < segment_size_) {
+                        break;
+                    }
+                }
+            }
+            catch (...) {
+                queue.failed = true;
+                close_queue();
+                workers.join();
+                throw;
+            }
+
+            close_queue();
+            workers.join();
+
+            if (queue.failed) {
+                return 1;
+            }
+
+            if (hasher) {
+                verify_checksum(_session.acquire(), _logical_path, hasher->final());
+            }
+
+            return 0;
+        }
+
+        auto put_segments(transfer_session& _session, segment_queue& _queue, const ifs::path& _to) -> void
+        {
+            try {
+                transfer_session::connection conn;
+                std::optional<io::client::default_transport> tp;
+                io::odstream out;
+
+                while (true) {
+                    segment seg;
+
+                    {
+                        std::unique_lock lk{_queue.mtx};
+                        _queue.cv.wait(lk, [&_queue] { return _queue.closed || !_queue.segments.empty(); });
+
+                        if (_queue.segments.empty() || _queue.failed) {
+                            return;
+                        }
+
+                        seg = std::move(_queue.segments.front());
+                        _queue.segments.pop_front();
+                    }
+
+                    if (!conn) {
+                        conn = _session.acquire();
+                        tp.emplace(conn);
+                        out.open(*tp, _to, std::ios_base::in | std::ios_base::out);
+
+                        if (!out) {
+                            throw std::runtime_error{"Cannot open data object for writing [path: " + _to.string() + "]."};
+                        }
+                    }
+
+                    if (!out.seekp(seg.offset) || !out.write(seg.buffer.data(), static_cast<std::streamsize>(seg.size))) {
+                        throw std::runtime_error{"Cannot write data object [path: " + _to.string() + "]."};
+                    }
+                }
+            }
+            catch (const std::exception& e) {
+                std::cerr << "Error: " << e.what() << '\n';
+                _queue.failed = true;
+
+                // Wake the reader in case it is waiting for a segment buffer that
+                // will never be returned by this worker.
+                std::lock_guard lk{_queue.mtx};
+                _queue.segments.clear();
+            }
+        }
+
         auto put_from_physical_path(const rodsEnv& _env, const po::variables_map& _vm) -> int
         {
             try {
                 const auto from = fs::canonical(_vm["physical_path"].as<std::string>());
                 const ifs::path to = _vm["logical_path"].as<std::string>();
 
+                // Completed files and ranges are recorded in the journal. With --resume,
+                // the records left behind by an interrupted run are used to skip work
+                // that has already been done.
+                const auto journal_path = _vm.count("journal")
+                    ? fs::path{_vm["journal"].as<std::string>()}
+                    : transfer_journal::default_path("put", from.generic_string() + '\n' + to.string());
+                journal_ = std::make_unique<transfer_journal>(journal_path, _vm.count("resume") > 0);
+
+                // Every connection used by the command, whether by a small file or by
+                // a range of a large file, comes from this session.
+                std::optional<transfer_session> own_session;
+                auto& session = session_for(_env, connection_pool_size_, own_session);
+
                 if (fs::is_regular_file(from)) {
-                    put_file(_env, from, to / from.filename().string());
+                    if (sync_) {
+                        const auto snapshot = fetch_catalog_snapshot(session.acquire(), to.string());
+
+                        if (!needs_upload(from, snapshot)) {
+                            return 0;
+                        }
+                    }
+
+                    irods::thread_pool thread_pool{connection_pool_size_};
+                    put_file(session, thread_pool, from, to / from.filename().string());
+                    thread_pool.join();
                 }
                 else if (fs::is_directory(from)) {
-                    const auto pool_size = _vm["connection_pool_size"].as<int>();
-                    irods::connection_pool conn_pool{pool_size, _env.rodsHost, _env.rodsPort, _env.rodsUserName, _env.rodsZone, 600};
+                    session.warm_up(connection_pool_size_);
+
                     irods::thread_pool thread_pool{static_cast<int>(std::thread::hardware_concurrency())};
-                    put_directory(conn_pool, thread_pool, from, to / std::rbegin(from)->string());
+
+                    if (_vm.count("bundle")) {
+                        const auto bundle_size = static_cast<std::uintmax_t>(_vm["bundle_size"].as<int>()) * 1_MB;
+                        const auto file_size_limit = static_cast<std::uintmax_t>(_vm["bundle_file_size_limit"].as<int>()) * 1_MB;
+                        put_directory_bundled(session, thread_pool, from, to / std::rbegin(from)->string(), bundle_size, file_size_limit);
+                    }
+                    else {
+                        put_directory(session, thread_pool, from, to / std::rbegin(from)->string());
+                    }
+
                     thread_pool.join();
                 }
                 else {
                     std::cerr << "Error: Path must point to a file or directory.\n";
                     return 1;
                 }
+
+                if (_vm.count("verbose")) {
+                    std::cerr << "Connections opened: " << session.connections_opened()
+                              << ", reused: " << session.connections_reused() << '\n';
+                }
+
+                if (failed_) {
+                    std::cerr << "Error: Some files could not be uploaded. Rerun with --resume to retry them.\n";
+                    return 1;
+                }
+
+                journal_->remove();
             }
             catch (const std::exception& e) {
                 std::cerr << "Error: " << e.what() << '\n';
@@ -165,136 +562,370 @@ namespace irods::cli
             return 0;
         }
 
-        auto put_file_chunk(irods::connection_pool& _cpool,
-                            const fs::path& _from,
-                            const ifs::path& _to,
-                            unsigned long _offset,
-                            unsigned long _chunk_size) -> void
+        // Decides whether a local file differs from the data object of the same
+        // name in a catalog snapshot. Files are compared by size and mtime, and,
+        // with --sync_checksum, by content. Errors err on the side of uploading.
+        auto needs_upload(const fs::path& _from, const catalog_snapshot& _snapshot) -> bool
         {
             try {
-                std::ifstream in{_from.c_str(), std::ios_base::binary};
+                const auto iter = _snapshot.find(_from.filename().string());
 
-                if (!in) {
-                    throw std::runtime_error{"Cannot open file for reading."};
+                if (iter == std::end(_snapshot)) {
+                    return true;
                 }
 
-                auto conn = _cpool.get_connection();
-                io::client::default_transport tp{conn};
-                io::odstream out{tp, _to};
+                const auto& e = iter->second;
 
-                if (!out) {
-                    throw std::runtime_error{"Cannot open data object for writing [path: " + _to.string() + "]."};
+                if (e.size != fs::file_size(_from) || fs::last_write_time(_from) > e.mtime) {
+                    return true;
                 }
 
-                if (!in.seekg(_offset)) {
-                    throw std::runtime_error{"Seek failed [path: " + _from.generic_string() + "]."};
+                if (sync_checksum_) {
+                    // Only SHA-256 checksums can be compared with the local file.
+                    if (e.checksum.rfind("sha2:", 0) != 0) {
+                        return true;
+                    }
+
+                    auto buf = buffers_->acquire();
+                    return file_checksum(_from.string(), buf.data(), buf.size()) != e.checksum;
                 }
 
-                if (!out.seekp(_offset)) {
-                    throw std::runtime_error{"Seek failed [path: " + _to.string() + "]."};
+                return false;
+            }
+            catch (const std::exception&) {
+                return true;
+            }
+        }
+
+        // Identifies a source file in the journal. The size and mtime are part of
+        // the key so that a file modified between runs is uploaded again.
+        static auto journal_key(const fs::path& _from, std::uintmax_t _file_size) -> std::string
+        {
+            return _from.generic_string() + '|' + std::to_string(_file_size) + '|' +
+                   std::to_string(fs::last_write_time(_from));
+        }
+
+        // Shared by every worker taking part in the upload of a single large file.
+        struct chunked_upload
+        {
+            chunked_upload(std::uintmax_t _file_size, std::uintmax_t _chunk_size, std::string _key)
+                : scheduler{_file_size, _chunk_size}
+                , chunks_remaining{scheduler.chunk_count()}
+                , key{std::move(_key)}
+            {
+            }
+
+            chunk_scheduler scheduler;
+            std::uintmax_t chunks_remaining;
+            int open_streams = 0;
+            const std::string key;
+            std::unique_ptr<mapped_file> source;
+            std::unique_ptr<reordering_sha256> hasher;
+            std::atomic<bool> failed{false};
+            std::mutex mtx;
+            std::condition_variable cv;
+        }; // struct chunked_upload
+
+        // Uploads ranges handed out by the scheduler until none remain. The
+        // streams and up to --io_depth buffers are acquired once per worker,
+        // before any range is claimed, and the streams are repositioned for
+        // every range. Local reads go through the I/O engine, which keeps the
+        // next pieces of the range in flight while the current one is sent.
+        // With --zero_copy, ranges are written straight from the mapped source
+        // file and no buffer is needed. With --checksum, the pieces read are
+        // handed to the upload's hasher. Every range claimed by a worker is accounted
+        // for, even on failure, so that the owner of the upload is never left
+        // waiting. A failure poisons the connection.
+        auto put_file_chunks(transfer_session::connection& _conn, chunked_upload& _upload, const fs::path& _from, const ifs::path& _to)
+            -> void
+        {
+            const auto finish_chunk = [&_upload] {
+                std::lock_guard lk{_upload.mtx};
+
+                if (--_upload.chunks_remaining == 0) {
+                    _upload.cv.notify_all();
                 }
+            };
+
+            std::optional<file_descriptor> in;
+            io::client::default_transport tp{_conn};
+            io::odstream out;
+            bool streams_open = false;
+            auto bufs = _upload.source ? std::vector<buffer_pool::buffer>{} : buffers_->acquire_batch(io_depth_);
+            local_io_engine engine{bufs};
+
+            while (const auto range = _upload.scheduler.next()) {
+                try {
+                    if (_upload.failed) {
+                        finish_chunk();
+                        continue;
+                    }
+
+                    if (journal_->is_range_complete(_upload.key, *range)) {
+                        if (_upload.hasher) {
+                            _upload.hasher->skip(range->offset, range->size);
+                        }
+
+                        finish_chunk();
+                        continue;
+                    }
+
+                    if (!streams_open) {
+                        if (!_upload.source) {
+                            in.emplace(_from.string(), O_RDONLY);
+                        }
+
+                        {
+                            std::lock_guard lk{_upload.mtx};
+                            ++_upload.open_streams;
+                        }
+
+                        streams_open = true;
+
+                        out.open(tp, _to, std::ios_base::in | std::ios_base::out);
+
+                        if (!out) {
+                            throw std::runtime_error{"Cannot open data object for writing [path: " + _to.string() + "]."};
+                        }
+                    }
+
+                    if (!out.seekp(range->offset)) {
+                        throw std::runtime_error{"Seek failed [path: " + _to.string() + "]."};
+                    }
+
+                    std::uintmax_t bytes_pushed = 0;
+
+                    if (_upload.source) {
+                        if (_upload.source->size() >= range->offset + range->size) {
+                            bytes_pushed = write_mapped(out, *_upload.source, range->offset, range->size, nullptr);
+                        }
+                    }
+                    else {
+                        const auto piece = buffers_->buffer_size();
+                        const auto piece_count = (range->size + piece - 1) / piece;
+                        const auto piece_size = [&range, piece](std::uintmax_t _i) {
+                            return static_cast<std::size_t>(std::min<std::uintmax_t>(piece, range->size - _i * piece));
+                        };
+                        const auto depth = engine.buffer_count();
+                        std::uintmax_t queued = 0;
+
+                        for (; queued < std::min<std::uintmax_t>(depth, piece_count); ++queued) {
+                            engine.queue_read(in->get(), queued % depth, piece_size(queued), range->offset + queued * piece);
+                        }
+
+                        engine.submit();
+
+                        for (std::uintmax_t i = 0; i < piece_count; ++i) {
+                            const auto b = i % depth;
+                            const auto n = engine.wait(b);
+
+                            if (!out.write(engine.buffer(b), static_cast<std::streamsize>(n))) {
+                                break;
+                            }
+
+                            if (_upload.hasher) {
+                                _upload.hasher->update(range->offset + bytes_pushed, engine.buffer(b), n);
+                            }
+
+                            bytes_pushed += n;
 
-                std::array<char, 4_MB> buf{};
-                unsigned long bytes_pushed = 0;
+                            // The file shrank since the upload started.
+                            if (n < piece_size(i)) {
+                                break;
+                            }
 
-                while (in && bytes_pushed < _chunk_size) {
-                    in.read(buf.data(), std::min(buf.size(), _chunk_size));
-                    out.write(buf.data(), in.gcount());
-                    bytes_pushed += in.gcount();
+                            if (queued < piece_count) {
+                                engine.queue_read(in->get(), b, piece_size(queued), range->offset + queued * piece);
+                                engine.submit();
+                                ++queued;
+                            }
+                        }
+
+                        engine.drain();
+                    }
+
+                    // The range is only recorded once its bytes have left the stream buffer.
+                    if (!out.flush() || bytes_pushed < range->size) {
+                        throw std::runtime_error{"Short transfer [path: " + _from.generic_string() + "]."};
+                    }
+
+                    journal_->mark_range_complete(_upload.key, *range);
+                    finish_chunk();
+                }
+                catch (const std::exception& e) {
+                    std::cerr << "Error: " << e.what() << '\n';
+                    _upload.failed = true;
+                    _conn.poison();
+                    engine.drain();
+
+                    if (_upload.hasher) {
+                        _upload.hasher->abort();
+                    }
+
+                    finish_chunk();
                 }
             }
-            catch (const std::exception& e) {
-                std::cerr << "Error: " << e.what() << '\n';
+
+            // The owner of the upload waits for every stream to be closed, so that
+            // the data object is complete by the time it is verified or reported.
+            if (streams_open) {
+                out.close();
+
+                std::lock_guard lk{_upload.mtx};
+
+                if (--_upload.open_streams == 0) {
+                    _upload.cv.notify_all();
+                }
             }
         }
 
-        auto put_file(const rodsEnv& _env, const fs::path& _from, const ifs::path& _to) -> void
+        auto put_file(transfer_session& _session,
+                      irods::thread_pool& _thread_pool,
+                      const fs::path& _from,
+                      const ifs::path& _to) -> void
         {
             try {
                 const auto file_size = fs::file_size(_from);
+                const auto key = journal_key(_from, file_size);
+
+                if (journal_->is_file_complete(key)) {
+                    return;
+                }
 
                 // If the local file's size is less than 32MB, then stream the file
                 // over a single connection.
                 if (file_size < 32_MB) {
-                    irods::connection_pool cpool{1, _env.rodsHost, _env.rodsPort, _env.rodsUserName, _env.rodsZone, 600};
+                    auto conn = _session.acquire();
+                    const auto checksum = put_file(conn, _from, _to);
 
-                    // If the local file is empty, just create an empty data object
-                    // on the iRODS server and return.
-                    if (file_size == 0) {
-                        auto conn = cpool.get_connection();
-                        io::client::default_transport tp{conn};
-                        io::odstream out{tp, _to};
+                    if (checksum_) {
+                        verify_checksum(conn, _to, checksum);
+                    }
 
-                        if (!out) {
-                            throw std::runtime_error{"Cannot open data object for writing [path: " + _to.string() + "]."};
-                        }
+                    journal_->mark_file_complete(key);
+                    return;
+                }
+
+                // The file is cut into many ranges of the configured chunk size. The
+                // calling task uploads ranges itself and recruits helpers from the
+                // thread pool. Helpers only join while the session has a connection
+                // to spare, so large files and small files share the same bounded
+                // set of connections and the caller can never deadlock waiting on
+                // helpers that are stuck behind it in the queue.
+                auto upload = std::make_shared<chunked_upload>(file_size, chunk_size_, key);
+                const auto worker_count = chunk_scheduler::worker_count(file_size, chunk_size_, _session.max_connections());
+
+                // The upload starts on the first connection; helpers join as the
+                // others finish their handshakes.
+                _session.warm_up(worker_count);
+                auto conn = _session.acquire();
+
+                // A partially uploaded data object left behind by an interrupted run
+                // must not be truncated, or the ranges recorded in the journal would
+                // be lost.
+                const auto resuming = journal_->has_ranges(key);
+
+                if (!resuming) {
+                    io::client::default_transport tp{conn};
+                    io::odstream{tp, _to};
+                }
+
+                // Files that cannot be leased are read with the I/O engine instead.
+                if (zero_copy_) {
+                    upload->source = mapped_file::map_leased(_from.string());
+                }
 
-                        return;
+                std::future<std::string> checksum;
+
+                if (checksum_) {
+                    if (!upload->source) {
+                        const auto window = std::max<std::size_t>(buffers_->max_buffers() / 2, 1);
+                        upload->hasher = std::make_unique<reordering_sha256>(*buffers_, file_size, window);
                     }
 
-                    put_file(cpool.get_connection(), _from, _to);
+                    checksum = checksum_in_background(upload, _from);
+                }
 
-                    return;
+                for (int i = 1; i < worker_count; ++i) {
+                    irods::thread_pool::post(_thread_pool, [this, &_session, upload, _from, _to] {
+                        if (auto helper_conn = _session.try_acquire(); helper_conn) {
+                            put_file_chunks(helper_conn, *upload, _from, _to);
+                        }
+                    });
                 }
 
-                using int_type = unsigned long;
+                put_file_chunks(conn, *upload, _from, _to);
 
-                constexpr int_type thread_count = 3;
-                irods::connection_pool cpool{thread_count, _env.rodsHost, _env.rodsPort, _env.rodsUserName, _env.rodsZone, 600};
-                irods::thread_pool tpool{static_cast<int>(thread_count)};
+                {
+                    std::unique_lock lk{upload->mtx};
+                    upload->cv.wait(lk, [&upload] { return upload->chunks_remaining == 0 && upload->open_streams == 0; });
+                }
 
-                const int_type chunk_size = file_size / thread_count;
-                const int_type remainder = file_size % thread_count;
+                const auto digest = checksum.valid() ? checksum.get() : std::string{};
 
-                {
-                    auto conn = cpool.get_connection();
-                    io::client::default_transport tp{conn};
-                    io::odstream{tp, _to};
+                // Writers waiting for the lease need not wait for the verification.
+                if (upload->source) {
+                    upload->source->unmap();
                 }
 
-                for (int_type i = 0; i < thread_count; ++i) {
-                    irods::thread_pool::post(tpool, [&, offset = i * chunk_size] {
-                        put_file_chunk(cpool, _from, _to, offset, chunk_size);
-                    });
+                if (upload->failed) {
+                    failed_ = true;
+                    return;
                 }
 
-                if (remainder > 0) {
-                    irods::thread_pool::post(tpool, [&, offset = thread_count * chunk_size] {
-                        put_file_chunk(cpool, _from, _to, offset, remainder);
-                    });
+                if (checksum_) {
+                    verify_checksum(conn, _to, digest);
                 }
 
-                tpool.join();
+                journal_->mark_file_complete(key);
             }
             catch (const std::exception& e) {
                 std::cerr << "Error: " << e.what() << '\n';
+                failed_ = true;
             }
         }
 
-        auto put_file(rcComm_t& _comm, const fs::path& _from, const ifs::path& _to) -> void
+        // Computes the checksum of a file uploaded in ranges on a thread of its
+        // own, so that the workers never wait for the digest. The pieces the
+        // workers read are hashed in file order as they arrive (see
+        // reordering_sha256); only ranges skipped on resume, and pieces that
+        // arrive too far ahead of the others, are read again. A mapped source is
+        // hashed straight from the mapping, which shares its pages with the
+        // workers. Hashing stops early once the upload has failed.
+        auto checksum_in_background(std::shared_ptr<chunked_upload> _upload, const fs::path& _from) -> std::future<std::string>
         {
-            try {
-                const auto file_size = fs::file_size(_from);
+            return std::async(std::launch::async, [this, _upload, _from] {
+                if (_upload->hasher) {
+                    return _upload->hasher->run(_from.string());
+                }
 
-                // If the local file is empty, just create an empty data object
-                // on the iRODS server and return.
-                if (file_size == 0) {
-                    io::client::default_transport tp{_comm};
-                    io::odstream out{tp, _to};
+                const auto& source = *_upload->source;
+                const auto slice = buffers_->buffer_size();
+                sha256 hasher;
 
-                    if (!out) {
-                        throw std::runtime_error{"Cannot open data object for writing [path: " + _to.string() + "]."};
+                for (std::uintmax_t offset = 0; offset < source.size() && !_upload->failed;) {
+                    const auto n = static_cast<std::size_t>(std::min<std::uintmax_t>(slice, source.size() - offset));
+
+                    if (!source.read_slice([&] { hasher.update(source.data() + offset, n); })) {
+                        throw std::runtime_error{"File changed during upload [path: " + _from.generic_string() + "]."};
                     }
 
-                    return;
+                    offset += n;
                 }
 
-                std::ifstream in{_from.c_str(), std::ios_base::binary};
+                return hasher.final();
+            });
+        }
 
-                if (!in) {
-                    throw std::runtime_error{"Cannot open file for reading [path: " + _from.generic_string() + "]."};
-                }
+        // Streams a file over a single connection. Returns the SHA-256 checksum of
+        // the bytes sent if --checksum is in effect, otherwise an empty string.
+        auto put_file(rcComm_t& _comm, const fs::path& _from, const ifs::path& _to) -> std::string
+        {
+            const auto file_size = fs::file_size(_from);
 
+            // If the local file is empty, just create an empty data object
+            // on the iRODS server and return.
+            if (file_size == 0) {
                 io::client::default_transport tp{_comm};
                 io::odstream out{tp, _to};
 
@@ -302,42 +933,432 @@ namespace irods::cli
                     throw std::runtime_error{"Cannot open data object for writing [path: " + _to.string() + "]."};
                 }
 
-                std::array<char, 4_MB> buf{};
+                return checksum_ ? sha256{}.final() : std::string{};
+            }
 
-                while (in) {
-                    in.read(buf.data(), buf.size());
-                    out.write(buf.data(), in.gcount());
+            if (zero_copy_) {
+                if (const auto source = mapped_file::map_leased(_from.string()); source) {
+                    return put_mapped_file(_comm, *source, _from, _to);
                 }
             }
-            catch (const std::exception& e) {
-                std::cerr << "Error: " << e.what() << '\n';
+
+            std::ifstream in{_from.c_str(), std::ios_base::binary};
+
+            if (!in) {
+                throw std::runtime_error{"Cannot open file for reading [path: " + _from.generic_string() + "]."};
+            }
+
+            io::client::default_transport tp{_comm};
+            io::odstream out{tp, _to};
+
+            if (!out) {
+                throw std::runtime_error{"Cannot open data object for writing [path: " + _to.string() + "]."};
+            }
+
+            std::optional<sha256> hasher;
+
+            if (checksum_) {
+                hasher.emplace();
+            }
+
+            run_pipeline(*buffers_, pipeline_depth_, read_stage(in, hasher), write_stage(out, _to));
+
+            if (!out.flush()) {
+                throw std::runtime_error{"Cannot write data object [path: " + _to.string() + "]."};
+            }
+
+            return hasher ? hasher->final() : std::string{};
+        }
+
+        // Writes _size bytes of a leased mapping, starting at _offset, one buffer
+        // size at a time, and hashes them if _hasher is given. Stops early if the
+        // file is about to be modified, so that the mapping is never read past
+        // the end of a truncated file. Returns the number of bytes written.
+        auto write_mapped(std::ostream& _out, const mapped_file& _source, std::uintmax_t _offset, std::uintmax_t _size, sha256* _hasher)
+            -> std::uintmax_t
+        {
+            const auto slice = buffers_->buffer_size();
+            std::uintmax_t written = 0;
+
+            while (written < _size) {
+                const auto* data = _source.data() + _offset + written;
+                const auto n = static_cast<std::size_t>(std::min<std::uintmax_t>(slice, _size - written));
+                bool ok = false;
+
+                const auto read = _source.read_slice([&] {
+                    ok = static_cast<bool>(_out.write(data, static_cast<std::streamsize>(n)));
+
+                    if (ok && _hasher) {
+                        _hasher->update(data, n);
+                    }
+                });
+
+                if (!read || !ok) {
+                    break;
+                }
+
+                written += n;
+            }
+
+            return written;
+        }
+
+        // Writes a whole file to a data object straight from a mapping of the
+        // file. Kernel readahead takes the place of the pipeline's reader stage.
+        auto put_mapped_file(rcComm_t& _comm, const mapped_file& _source, const fs::path& _from, const ifs::path& _to)
+            -> std::string
+        {
+            io::client::default_transport tp{_comm};
+            io::odstream out{tp, _to};
+
+            if (!out) {
+                throw std::runtime_error{"Cannot open data object for writing [path: " + _to.string() + "]."};
+            }
+
+            std::optional<sha256> hasher;
+
+            if (checksum_) {
+                hasher.emplace();
+            }
+
+            const auto written = write_mapped(out, _source, 0, _source.size(), hasher ? &*hasher : nullptr);
+
+            if (written < _source.size() && _source.changed()) {
+                throw std::runtime_error{"File changed during upload [path: " + _from.generic_string() + "]."};
+            }
+
+            if (written < _source.size() || !out.flush()) {
+                throw std::runtime_error{"Cannot write data object [path: " + _to.string() + "]."};
+            }
+
+            return hasher ? hasher->final() : std::string{};
+        }
+
+        // Asks the server to compute (and register) the checksum of the data
+        // object, then compares it with the checksum computed while uploading.
+        auto verify_checksum(rcComm_t& _comm, const ifs::path& _path, const std::string& _expected) -> void
+        {
+            dataObjInp_t input{};
+            std::strncpy(input.objPath, _path.c_str(), sizeof(input.objPath) - 1);
+            addKeyVal(&input.condInput, FORCE_CHKSUM_KW, "");
+
+            char* checksum = nullptr;
+            const auto ec = rcDataObjChksum(&_comm, &input, &checksum);
+            clearKeyVal(&input.condInput);
+
+            std::unique_ptr<char, decltype(&std::free)> checksum_guard{checksum, &std::free};
+
+            if (ec < 0 || !checksum) {
+                throw std::runtime_error{"Cannot compute checksum [path: " + _path.string() + ", error code: " + std::to_string(ec) + "]."};
+            }
+
+            // A server configured for a different hash scheme cannot be compared
+            // against; its checksum is still registered.
+            if (std::string_view{checksum}.rfind("sha2:", 0) != 0) {
+                std::cerr << "Warning: Server checksum is not SHA-256, skipping verification [path: " << _path.string() << "].\n";
+                return;
+            }
+
+            if (_expected != checksum) {
+                throw std::runtime_error{"Checksum mismatch [path: " + _path.string() + "]."};
             }
         }
 
-        auto put_directory(irods::connection_pool& _conn_pool,
+        auto put_directory(transfer_session& _session,
                            irods::thread_pool& _thread_pool,
                            const fs::path& _from,
                            const ifs::path& _to) -> void
         {
-            ifs::client::create_collections(_conn_pool.get_connection(), _to);
+            std::shared_ptr<const catalog_snapshot> snapshot;
+
+            // Subdirectories are uploaded by thread pool tasks, which must not
+            // throw.
+            try {
+                auto conn = _session.acquire();
+                ifs::client::create_collections(conn, _to);
+
+                // One query per collection tells us which files can be skipped.
+                if (sync_) {
+                    snapshot = std::make_shared<const catalog_snapshot>(fetch_catalog_snapshot(conn, _to.string()));
+                }
+            }
+            catch (const std::exception& e) {
+                std::cerr << "Error: " << e.what() << '\n';
+                failed_ = true;
+                return;
+            }
 
             for (auto&& e : fs::directory_iterator{_from}) {
-                irods::thread_pool::post(_thread_pool, [this, &_conn_pool, &_thread_pool, e, _to]() {
+                irods::thread_pool::post(_thread_pool, [this, &_session, &_thread_pool, e, _to, snapshot]() {
                     const auto& from = e.path();
 
                     if (fs::is_regular_file(e.status())) {
-                        put_file(_conn_pool.get_connection(), from, _to / from.filename().string());
+                        if (snapshot && !needs_upload(from, *snapshot)) {
+                            return;
+                        }
+
+                        put_file(_session, _thread_pool, from, _to / from.filename().string());
                     }
                     else if (fs::is_directory(e.status())) {
-                        put_directory(_conn_pool, _thread_pool, from, _to / std::rbegin(from)->string());
+                        put_directory(_session, _thread_pool, from, _to / std::rbegin(from)->string());
                     }
                 });
             }
         }
+
+        struct bundle_entry
+        {
+            fs::path path;
+            std::string name;
+            std::uintmax_t size;
+            std::time_t mtime;
+            unsigned mode;
+            bool directory;
+            std::string key;
+        }; // struct bundle_entry
+
+        // Walks the directory tree and packs files no larger than the file size
+        // limit into tar bundles of roughly the bundle size. Each bundle is
+        // streamed straight into a data object, which the server then extracts
+        // and registers under the target collection. Larger files are uploaded
+        // individually as usual.
+        auto put_directory_bundled(transfer_session& _session,
+                                   irods::thread_pool& _thread_pool,
+                                   const fs::path& _from,
+                                   const ifs::path& _to,
+                                   std::uintmax_t _bundle_size,
+                                   std::uintmax_t _file_size_limit) -> void
+        {
+            ifs::client::create_collections(_session.acquire(), _to);
+
+            std::vector<bundle_entry> entries;
+            std::uintmax_t bundle_bytes = 0;
+            int bundle_count = 0;
+
+            // Bundles are staged in the target collection under names that no
+            // other run, and no user data object, is going to use, since the
+            // extraction overwrites whatever is in its way.
+            const auto bundle_prefix = ".irods_bundle." + unique_token() + '.';
+
+            // With --sync, the catalog snapshot of every collection on the path to
+            // the current entry is kept, indexed by depth, so that each collection
+            // is queried once even though the walk interleaves its entries with
+            // those of its subcollections.
+            std::vector<std::pair<ifs::path, catalog_snapshot>> snapshots;
+
+            const auto snapshot_for = [&](const ifs::path& _collection, std::size_t _depth) -> const catalog_snapshot& {
+                snapshots.resize(_depth + 1);
+
+                if (auto& [collection, snapshot] = snapshots[_depth]; collection.string() != _collection.string()) {
+                    collection = _collection;
+                    snapshot = fetch_catalog_snapshot(_session.acquire(), _collection.string());
+                }
+
+                return snapshots[_depth].second;
+            };
+
+            const auto flush = [&] {
+                if (entries.empty()) {
+                    return;
+                }
+
+                const auto bundle_path = _to / (bundle_prefix + std::to_string(bundle_count++) + ".tar");
+
+                irods::thread_pool::post(_thread_pool, [this, &_session, entries = std::move(entries), bundle_path, _to] {
+                    put_bundle(_session, entries, bundle_path, _to);
+                });
+
+                entries.clear();
+                bundle_bytes = 0;
+            };
+
+            for (auto iter = fs::recursive_directory_iterator{_from}; iter != fs::recursive_directory_iterator{}; ++iter) {
+                const auto& e = *iter;
+                const auto name = e.path().lexically_relative(_from).generic_string();
+
+                if (fs::is_directory(e.status())) {
+                    entries.push_back({e.path(), name, 0, fs::last_write_time(e.path()), permissions_of(e), true, {}});
+                    bundle_bytes += tar::block_size;
+                }
+                else if (fs::is_regular_file(e.status())) {
+                    const auto size = fs::file_size(e.path());
+
+                    if (sync_ && !needs_upload(e.path(), snapshot_for((_to / name).parent_path(), iter.depth()))) {
+                        continue;
+                    }
+
+                    if (size > _file_size_limit) {
+                        irods::thread_pool::post(_thread_pool, [this, &_session, &_thread_pool, from = e.path(), to = _to / name] {
+                            try {
+                                ifs::client::create_collections(_session.acquire(), to.parent_path());
+                            }
+                            catch (const std::exception& e) {
+                                std::cerr << "Error: " << e.what() << '\n';
+                                failed_ = true;
+                                return;
+                            }
+
+                            put_file(_session, _thread_pool, from, to);
+                        });
+
+                        continue;
+                    }
+
+                    auto key = journal_key(e.path(), size);
+
+                    if (journal_->is_file_complete(key)) {
+                        continue;
+                    }
+
+                    entries.push_back({e.path(), name, size, fs::last_write_time(e.path()), permissions_of(e), false, std::move(key)});
+                    bundle_bytes += tar::block_size + tar::padded_size(size);
+                }
+
+                if (bundle_bytes >= _bundle_size) {
+                    flush();
+                }
+            }
+
+            flush();
+        }
+
+        static auto permissions_of(const fs::directory_entry& _e) -> unsigned
+        {
+            return static_cast<unsigned>(_e.status().permissions()) & 07777;
+        }
+
+        static auto unique_token() -> std::string
+        {
+            std::random_device device;
+            const auto value = (static_cast<std::uint64_t>(device()) << 32) | device();
+
+            char token[32];
+            std::snprintf(token, sizeof(token), "%d.%016llx", static_cast<int>(::getpid()), static_cast<unsigned long long>(value));
+
+            return token;
+        }
+
+        auto put_bundle(transfer_session& _session,
+                        const std::vector<bundle_entry>& _entries,
+                        const ifs::path& _bundle_path,
+                        const ifs::path& _collection) -> void
+        {
+            transfer_session::connection conn;
+
+            try {
+                conn = _session.acquire();
+
+                {
+                    io::client::default_transport tp{conn};
+                    io::odstream out{tp, _bundle_path};
+
+                    if (!out) {
+                        throw std::runtime_error{"Cannot open data object for writing [path: " + _bundle_path.string() + "]."};
+                    }
+
+                    auto buf = buffers_->acquire();
+
+                    for (auto&& e : _entries) {
+                        if (e.directory) {
+                            tar::write_header(out, e.name, 0, e.mtime, e.mode, tar::entry_type::directory);
+                            continue;
+                        }
+
+                        tar::write_header(out, e.name, e.size, e.mtime, e.mode, tar::entry_type::regular_file);
+
+                        // The header has already promised e.size bytes, so a file that
+                        // shrank since the directory walk is padded with zeros to keep
+                        // the archive well-formed.
+                        std::ifstream in{e.path.c_str(), std::ios_base::binary};
+                        std::uintmax_t bytes_pushed = 0;
+
+                        while (in && bytes_pushed < e.size) {
+                            in.read(buf.data(), std::min<std::uintmax_t>(buf.size(), e.size - bytes_pushed));
+                            out.write(buf.data(), in.gcount());
+                            bytes_pushed += in.gcount();
+                        }
+
+                        if (bytes_pushed < e.size) {
+                            std::cerr << "Error: Short read [path: " << e.path.generic_string() << "].\n";
+                            failed_ = true;
+                            std::fill_n(buf.data(), std::min<std::uintmax_t>(buf.size(), e.size - bytes_pushed), '\0');
+
+                            while (bytes_pushed < e.size) {
+                                const auto count = std::min<std::uintmax_t>(buf.size(), e.size - bytes_pushed);
+                                out.write(buf.data(), count);
+                                bytes_pushed += count;
+                            }
+                        }
+
+                        tar::write_padding(out, e.size);
+                    }
+
+                    tar::write_end_of_archive(out);
+
+                    if (!out) {
+                        throw std::runtime_error{"Cannot write bundle [path: " + _bundle_path.string() + "]."};
+                    }
+                }
+
+                extract_bundle(conn, _bundle_path, _collection);
+                ifs::client::remove(conn, _bundle_path, ifs::remove_options::no_trash);
+
+                for (auto&& e : _entries) {
+                    if (!e.directory) {
+                        journal_->mark_file_complete(e.key);
+                    }
+                }
+            }
+            catch (const std::exception& e) {
+                std::cerr << "Error: " << e.what() << '\n';
+                failed_ = true;
+
+                // A bundle left behind would show up among the user's data.
+                if (conn) {
+                    try {
+                        if (ifs::client::exists(conn, _bundle_path)) {
+                            ifs::client::remove(conn, _bundle_path, ifs::remove_options::no_trash);
+                        }
+                    }
+                    catch (const std::exception&) {
+                    }
+                }
+
+                conn.poison();
+            }
+        }
+
+        auto extract_bundle(rcComm_t& _comm, const ifs::path& _bundle_path, const ifs::path& _collection) -> void
+        {
+            structFileExtAndRegInp_t input{};
+            std::strncpy(input.objPath, _bundle_path.c_str(), sizeof(input.objPath) - 1);
+            std::strncpy(input.collection, _collection.c_str(), sizeof(input.collection) - 1);
+            addKeyVal(&input.condInput, DATA_TYPE_KW, "tar");
+            addKeyVal(&input.condInput, FORCE_FLAG_KW, "");
+
+            const auto ec = rcStructFileExtAndReg(&_comm, &input);
+            clearKeyVal(&input.condInput);
+
+            if (ec < 0) {
+                throw std::runtime_error{"Cannot extract bundle [path: " + _bundle_path.string() + ", error code: " + std::to_string(ec) + "]."};
+            }
+        }
+
+        std::unique_ptr<buffer_pool> buffers_;
+        std::unique_ptr<transfer_journal> journal_;
+        std::atomic<bool> failed_{false};
+        bool checksum_ = false;
+        bool sync_ = false;
+        bool sync_checksum_ = false;
+        bool zero_copy_ = false;
+        std::size_t io_depth_ = 4;
+        std::size_t pipeline_depth_ = 2;
+        std::size_t segment_size_ = 8_MB;
+        std::size_t in_flight_segments_ = 8;
+        int connection_pool_size_ = 4;
+        std::uintmax_t chunk_size_ = 32_MB;
     }; // class put
 } // namespace irods::cli
 
-// TODO Need to investigate whether this is truely required.
-//extern "C" BOOST_SYMBOL_EXPORT irods::cli::put cli_impl;
-irods::cli::put cli_impl;
+IRODS_CLI_COMMAND(put)
 
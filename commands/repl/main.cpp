@@ -1,7 +1,8 @@
 #include "command.hpp"
+#include "metadata_cache.hpp"
+#include "transfer_session.hpp"
 
 #include <irods/rodsClient.h>
-#include <irods/connection_pool.hpp>
 #include <irods/filesystem.hpp>
 #include <irods/irods_exception.hpp>
 
@@ -13,6 +14,7 @@
 
 #include <iostream>
 #include <string>
+#include <optional>
 
 namespace fs = irods::experimental::filesystem;
 namespace po = boost::program_options;
@@ -25,15 +27,9 @@ namespace {
     {
         exit_flag = true;
     }
-}
-
-
 
-namespace irods::cli
-{
-    void print_progress(const std::string& p)
+    void print_progress(boost::progress_display& prog, const std::string& p)
     {
-        static boost::progress_display prog{100};
         try {
             auto x = std::stoi(p.c_str(), nullptr, 10);
             while(prog.count() != x) {
@@ -43,8 +39,13 @@ namespace irods::cli
         catch(...) {
         }
     } // print_progress
+}
+
+
 
-    class cp : public command
+namespace irods::cli
+{
+    class repl : public command
     {
     public:
         auto name() const noexcept -> std::string_view override
@@ -78,6 +79,9 @@ irods repl [options] --source_resource <originating replica location> fully_qual
 
         auto execute(const std::vector<std::string>& args) -> int override
         {
+            // The command may run again in the same process (e.g. in the agent).
+            exit_flag = false;
+
             signal(SIGINT,  handle_signal);
             signal(SIGHUP,  handle_signal);
             signal(SIGTERM, handle_signal);
@@ -142,23 +146,32 @@ irods repl [options] --source_resource <originating replica location> fully_qual
                 return 1;
             }
 
-            irods::connection_pool conn_pool{1, env.rodsHost, env.rodsPort, env.rodsUserName, env.rodsZone, 600};
-            auto conn = conn_pool.get_connection();
+            std::optional<transfer_session> own_session;
+            auto conn = session_for(env, 1, own_session).acquire();
 
             const auto logical_path = vm["logical_path"].as<std::string>();
 
-            {
-                const auto object_status = fs::client::status(conn, logical_path);
+            const auto cache = metadata_cache::open(env);
+            const auto kind = object_kind_of(cache.get(), conn, logical_path);
 
-                if (!fs::client::is_collection(object_status) && !fs::client::is_data_object(object_status)) {
-                    std::cerr << "Error: Logical path does not point to a collection or data object. Do you need a fully qualified path?\n";
-                    return 1;
-                }
+            if (kind == object_kind::none) {
+                std::cerr << "Error: Logical path does not point to a collection or data object. Do you need a fully qualified path?\n";
+                return 1;
             }
 
             std::string progress{};
 
-            auto progress_handler = progress_flag ? print_progress : [](const std::string&) {};
+            std::optional<boost::progress_display> display;
+
+            auto progress_handler = [progress_flag, &display](const std::string& p) {
+                if (progress_flag) {
+                    if (!display) {
+                        display.emplace(100);
+                    }
+
+                    print_progress(*display, p);
+                }
+            };
 
             auto request = json{{"logical_path",    logical_path},
                                 {"source_resource", source_resource},
@@ -188,6 +201,16 @@ irods repl [options] --source_resource <originating replica location> fully_qual
                            request,
                            "replicate");
 
+            // Replication changes the replicas shown by long listings.
+            if (cache) {
+                if (kind == object_kind::data_object) {
+                    cache->invalidate(logical_path);
+                }
+                else {
+                    cache->clear();
+                }
+            }
+
             if(exit_flag) {
                 std::cout << "Operation Cancelled.\n";
             }
@@ -201,11 +224,9 @@ irods repl [options] --source_resource <originating replica location> fully_qual
             return 0;
         }
 
-    }; // class cp
+    }; // class repl
 
 } // namespace irods::cli
 
-// TODO Need to investigate whether this is truely required.
-extern "C" BOOST_SYMBOL_EXPORT irods::cli::cp cli_impl;
-irods::cli::cp cli_impl;
+IRODS_CLI_COMMAND(repl)
 
@@ -1,7 +1,8 @@
 #include "command.hpp"
+#include "metadata_cache.hpp"
+#include "transfer_session.hpp"
 
 #include <irods/rodsClient.h>
-#include <irods/connection_pool.hpp>
 #include <irods/filesystem.hpp>
 #include <irods/irods_exception.hpp>
 
@@ -13,6 +14,7 @@
 
 #include <iostream>
 #include <string>
+#include <optional>
 
 namespace fs = irods::experimental::filesystem;
 namespace po = boost::program_options;
@@ -25,15 +27,9 @@ namespace {
     {
         exit_flag = true;
     }
-}
-
-
 
-namespace irods::cli
-{
-    void print_progress(const std::string& p)
+    void print_progress(boost::progress_display& prog, const std::string& p)
     {
-        static boost::progress_display prog{100};
         try {
             auto x = std::stoi(p.c_str(), nullptr, 10);
             while(prog.count() != x) {
@@ -43,7 +39,12 @@ namespace irods::cli
         catch(...) {
         }
     } // print_progress
+}
+
+
 
+namespace irods::cli
+{
     class rm : public command
     {
     public:
@@ -74,6 +75,9 @@ irods rm [options] fully_qualified_logical_path
 
         auto execute(const std::vector<std::string>& args) -> int override
         {
+            // The command may run again in the same process (e.g. in the agent).
+            exit_flag = false;
+
             signal(SIGINT,  handle_signal);
             signal(SIGHUP,  handle_signal);
             signal(SIGTERM, handle_signal);
@@ -111,21 +115,30 @@ irods rm [options] fully_qualified_logical_path
             }
 
             const auto logical_path = vm["logical_path"].as<std::string>();
-            irods::connection_pool conn_pool{1, env.rodsHost, env.rodsPort, env.rodsUserName, env.rodsZone, 600};
-            auto conn = conn_pool.get_connection();
+            std::optional<transfer_session> own_session;
+            auto conn = session_for(env, 1, own_session).acquire();
 
-            {
-                const auto object_status = fs::client::status(conn, logical_path);
+            const auto cache = metadata_cache::open(env);
+            const auto kind = object_kind_of(cache.get(), conn, logical_path);
 
-                if (!fs::client::is_collection(object_status) && !fs::client::is_data_object(object_status)) {
-                    std::cerr << "Error: Logical path does not point to a collection or data object. Do you need a fully qualified path?\n";
-                    return 1;
-                }
+            if (kind == object_kind::none) {
+                std::cerr << "Error: Logical path does not point to a collection or data object. Do you need a fully qualified path?\n";
+                return 1;
             }
 
             std::string progress{};
 
-            auto progress_handler = progress_flag ? print_progress : [](const std::string&) {};
+            std::optional<boost::progress_display> display;
+
+            auto progress_handler = [progress_flag, &display](const std::string& p) {
+                if (progress_flag) {
+                    if (!display) {
+                        display.emplace(100);
+                    }
+
+                    print_progress(*display, p);
+                }
+            };
 
             auto cli = ia::client{};
             auto rep = cli(conn,
@@ -138,6 +151,16 @@ irods rm [options] fully_qualified_logical_path
                             {"progress",     progress_flag}},
                            "recursive_remove");
 
+            // Removing a collection removes everything below it as well.
+            if (cache) {
+                if (kind == object_kind::data_object) {
+                    cache->invalidate(logical_path);
+                }
+                else {
+                    cache->clear();
+                }
+            }
+
             if(exit_flag) {
                 std::cout << "Operation Cancelled.\n";
             }
@@ -155,7 +178,5 @@ irods rm [options] fully_qualified_logical_path
 
 } // namespace irods::cli
 
-// TODO Need to investigate whether this is truely required.
-extern "C" BOOST_SYMBOL_EXPORT irods::cli::rm cli_impl;
-irods::cli::rm cli_impl;
+IRODS_CLI_COMMAND(rm)
 
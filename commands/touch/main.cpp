@@ -1,7 +1,8 @@
 #include "command.hpp"
+#include "metadata_cache.hpp"
+#include "transfer_session.hpp"
 
 #include <irods/rodsClient.h>
-#include <irods/connection_pool.hpp>
 #include <irods/filesystem.hpp>
 
 #include <boost/program_options.hpp>
@@ -9,6 +10,7 @@
 
 #include <iostream>
 #include <string>
+#include <optional>
 #include <chrono>
 #include <vector>
 
@@ -65,16 +67,13 @@ namespace irods::cli
             }
 
             const auto logical_path = vm["logical_path"].as<std::string>();
-            irods::connection_pool conn_pool{1, env.rodsHost, env.rodsPort, env.rodsUserName, env.rodsZone, 600};
-            auto conn = conn_pool.get_connection();
+            std::optional<transfer_session> own_session;
+            auto conn = session_for(env, 1, own_session).acquire();
+            const auto cache = metadata_cache::open(env);
 
-            {
-                const auto object_status = fs::client::status(conn, logical_path);
-
-                if (!fs::client::is_collection(object_status) && !fs::client::is_data_object(object_status)) {
-                    std::cerr << "Error: Logical path does not point to a collection or data object.\n";
-                    return 1;
-                }
+            if (object_kind_of(cache.get(), conn, logical_path) == object_kind::none) {
+                std::cerr << "Error: Logical path does not point to a collection or data object.\n";
+                return 1;
             }
 
             // clang-format off
@@ -93,6 +92,10 @@ namespace irods::cli
 
             try {
                 fs::client::last_write_time(conn, logical_path, new_mtime);
+
+                if (cache) {
+                    cache->invalidate(logical_path);
+                }
             }
             catch (const fs::filesystem_error& e) {
                 std::cerr << "Error: " << e.what() << '\n';
@@ -104,7 +107,5 @@ namespace irods::cli
     }; // class touch
 } // namespace irods::cli
 
-// TODO Need to investigate whether this is truely required.
-//extern "C" BOOST_SYMBOL_EXPORT irods::cli::touch cli_impl;
-irods::cli::touch cli_impl;
+IRODS_CLI_COMMAND(touch)
 
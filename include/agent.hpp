@@ -0,0 +1,753 @@
+#ifndef IRODS_CLI_AGENT_HPP
+#define IRODS_CLI_AGENT_HPP
+
+#include "command.hpp"
+#include "command_runner.hpp"
+
+#include <irods/rodsClient.h>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio_ext.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <csignal>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+extern char** environ;
+
+// The agent (irods agent) is a long-lived process that keeps authenticated
+// connections open and runs commands on behalf of the irods executable, which
+// then only pays for a round trip over a Unix domain socket instead of for
+// loading plugins, connecting and authenticating.
+//
+// Connections cannot be handed to another process, so the agent runs the
+// commands itself. A client sends its arguments, working directory, umask and
+// environment, together with its standard input, output and error (as
+// SCM_RIGHTS), and receives the exit code once the command has finished.
+// Commands therefore read and write the client's files directly.
+//
+// The agent is a preforked server: every worker process accepts requests from
+// the shared socket, runs one command at a time and keeps its own session of
+// warm connections between commands. Workers whose command failed start over
+// with a new session, and workers whose command was interrupted are replaced.
+// Signal dispositions changed by a command are restored after it, but commands
+// stay loaded, so any other process-wide state a command keeps (e.g. in static
+// variables) carries over to the next command run by the same worker; commands
+// must reset such state when they start. There is one agent per user and
+// server, and clients only use the agent matching their iRODS environment.
+// Without HOME, there is no agent.
+namespace irods::cli::agent
+{
+    struct options
+    {
+        // The number of commands that can run at the same time.
+        int workers = 4;
+
+        // The maximum number of connections of each worker.
+        int connections = 4;
+    }; // struct options
+
+    // Identifies the server and the user whose connections an agent holds.
+    inline auto identity(const rodsEnv& _env) -> std::string
+    {
+        return std::string{_env.rodsUserName} + '#' + _env.rodsZone + '@' + _env.rodsHost + ':' + std::to_string(_env.rodsPort);
+    }
+
+    // Returns the path of the agent socket, or an empty string if HOME is unset.
+    inline auto socket_path(const rodsEnv& _env) -> std::string
+    {
+        // FNV-1a, so that the same identity maps to the same socket across builds.
+        std::uint64_t hash = 14695981039346656037ull;
+
+        for (auto c : identity(_env)) {
+            hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+        }
+
+        const char* home = std::getenv("HOME");
+
+        if (!home || !*home) {
+            return {};
+        }
+
+        return std::string{home} + "/.irods/cli_agent_" + std::to_string(hash) + ".sock";
+    }
+
+    namespace detail
+    {
+        // The number of bytes a request may have, which bounds what a worker reads
+        // from a misbehaving client.
+        inline constexpr std::uint32_t max_request_size = 16 * 1024 * 1024;
+
+        enum class reply_status : std::uint8_t
+        {
+            // The command ran; the reply carries its exit code.
+            executed = 0,
+
+            // The agent cannot run the command, e.g. because it holds connections
+            // for another user. The client runs it instead.
+            rejected = 1
+        };
+
+        struct request
+        {
+            std::uint32_t umask = 022;
+            std::string identity;
+            std::string cwd;
+            std::vector<std::string> environment;
+            std::vector<std::string> args;
+        }; // struct request
+
+        class descriptor
+        {
+        public:
+            explicit descriptor(int _fd = -1) noexcept
+                : fd_{_fd}
+            {
+            }
+
+            descriptor(const descriptor&) = delete;
+            auto operator=(const descriptor&) -> descriptor& = delete;
+
+            ~descriptor()
+            {
+                if (fd_ >= 0) {
+                    ::close(fd_);
+                }
+            }
+
+            auto get() const noexcept -> int
+            {
+                return fd_;
+            }
+
+        private:
+            const int fd_;
+        }; // class descriptor
+
+        inline auto write_all(int _fd, const void* _data, std::size_t _size) -> bool
+        {
+            const auto* p = static_cast<const char*>(_data);
+
+            while (_size > 0) {
+                const auto n = ::send(_fd, p, _size, MSG_NOSIGNAL);
+
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+
+                if (n <= 0) {
+                    return false;
+                }
+
+                p += n;
+                _size -= static_cast<std::size_t>(n);
+            }
+
+            return true;
+        }
+
+        inline auto read_all(int _fd, void* _data, std::size_t _size) -> bool
+        {
+            auto* p = static_cast<char*>(_data);
+
+            while (_size > 0) {
+                const auto n = ::read(_fd, p, _size);
+
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+
+                if (n <= 0) {
+                    return false;
+                }
+
+                p += n;
+                _size -= static_cast<std::size_t>(n);
+            }
+
+            return true;
+        }
+
+        inline auto make_address(const std::string& _path, sockaddr_un& _addr) -> bool
+        {
+            if (_path.size() >= sizeof(_addr.sun_path)) {
+                return false;
+            }
+
+            std::memset(&_addr, 0, sizeof(_addr));
+            _addr.sun_family = AF_UNIX;
+            std::memcpy(_addr.sun_path, _path.c_str(), _path.size() + 1);
+
+            return true;
+        }
+
+        // Returns a socket connected to the agent, or -1 if no agent is listening.
+        inline auto connect_to(const std::string& _path) -> int
+        {
+            sockaddr_un addr;
+
+            if (!make_address(_path, addr)) {
+                return -1;
+            }
+
+            const auto fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+            if (fd < 0) {
+                return -1;
+            }
+
+            if (::connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0) {
+                ::close(fd);
+                return -1;
+            }
+
+            return fd;
+        }
+
+        // Requests are a sequence of native-endian integers and length-prefixed
+        // strings, as client and agent always run on the same host.
+        inline auto append_integer(std::string& _out, std::uint32_t _value) -> void
+        {
+            _out.append(reinterpret_cast<const char*>(&_value), sizeof(_value));
+        }
+
+        inline auto append_string(std::string& _out, std::string_view _s) -> void
+        {
+            append_integer(_out, static_cast<std::uint32_t>(_s.size()));
+            _out.append(_s);
+        }
+
+        inline auto append_strings(std::string& _out, const std::vector<std::string>& _strings) -> void
+        {
+            append_integer(_out, static_cast<std::uint32_t>(_strings.size()));
+
+            for (auto&& s : _strings) {
+                append_string(_out, s);
+            }
+        }
+
+        inline auto encode(const request& _req) -> std::string
+        {
+            std::string out;
+            append_integer(out, _req.umask);
+            append_string(out, _req.identity);
+            append_string(out, _req.cwd);
+            append_strings(out, _req.environment);
+            append_strings(out, _req.args);
+
+            return out;
+        }
+
+        class decoder
+        {
+        public:
+            explicit decoder(std::string_view _data)
+                : data_{_data}
+            {
+            }
+
+            auto integer() -> std::uint32_t
+            {
+                std::uint32_t value;
+                std::memcpy(&value, take(sizeof(value)).data(), sizeof(value));
+                return value;
+            }
+
+            auto string() -> std::string
+            {
+                return std::string{take(integer())};
+            }
+
+            auto strings() -> std::vector<std::string>
+            {
+                std::vector<std::string> strings(integer());
+
+                for (auto& s : strings) {
+                    s = string();
+                }
+
+                return strings;
+            }
+
+        private:
+            auto take(std::size_t _size) -> std::string_view
+            {
+                if (_size > data_.size()) {
+                    throw std::runtime_error{"Truncated agent request."};
+                }
+
+                const auto s = data_.substr(0, _size);
+                data_.remove_prefix(_size);
+
+                return s;
+            }
+
+            std::string_view data_;
+        }; // class decoder
+
+        inline auto decode(std::string_view _data) -> request
+        {
+            decoder d{_data};
+            request req;
+            req.umask = d.integer();
+            req.identity = d.string();
+            req.cwd = d.string();
+            req.environment = d.strings();
+            req.args = d.strings();
+
+            return req;
+        }
+
+        // Sends the size of the request along with the standard streams of the
+        // process, followed by the request itself.
+        inline auto send_request(int _fd, const std::string& _payload) -> bool
+        {
+            auto size = static_cast<std::uint32_t>(_payload.size());
+            iovec iov{&size, sizeof(size)};
+
+            const int fds[] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+            alignas(cmsghdr) char control[CMSG_SPACE(sizeof(fds))]{};
+
+            msghdr msg{};
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+
+            auto* cmsg = CMSG_FIRSTHDR(&msg);
+            cmsg->cmsg_level = SOL_SOCKET;
+            cmsg->cmsg_type = SCM_RIGHTS;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+            std::memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+            ssize_t n;
+
+            do {
+                n = ::sendmsg(_fd, &msg, MSG_NOSIGNAL);
+            } while (n < 0 && errno == EINTR);
+
+            return n == sizeof(size) && write_all(_fd, _payload.data(), _payload.size());
+        }
+
+        // Receives a request and the standard streams of the client, which the
+        // caller owns afterwards.
+        inline auto receive_request(int _fd, int (&_streams)[3], request& _req) -> bool
+        {
+            std::uint32_t size;
+            iovec iov{&size, sizeof(size)};
+            alignas(cmsghdr) char control[CMSG_SPACE(sizeof(_streams))]{};
+
+            msghdr msg{};
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+
+            ssize_t n;
+
+            do {
+                n = ::recvmsg(_fd, &msg, MSG_CMSG_CLOEXEC);
+            } while (n < 0 && errno == EINTR);
+
+            const auto* cmsg = CMSG_FIRSTHDR(&msg);
+
+            if (!cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS ||
+                cmsg->cmsg_len != CMSG_LEN(sizeof(_streams)))
+            {
+                return false;
+            }
+
+            std::memcpy(_streams, CMSG_DATA(cmsg), sizeof(_streams));
+
+            if (n != sizeof(size) || (msg.msg_flags & MSG_CTRUNC) || size > max_request_size) {
+                return false;
+            }
+
+            std::string payload(size, '\0');
+
+            if (!read_all(_fd, payload.data(), payload.size())) {
+                return false;
+            }
+
+            try {
+                _req = decode(payload);
+            }
+            catch (const std::exception&) {
+                return false;
+            }
+
+            return true;
+        }
+
+        inline auto send_reply(int _fd, reply_status _status, int _exit_code) -> void
+        {
+            char reply[1 + sizeof(std::int32_t)];
+            reply[0] = static_cast<char>(_status);
+
+            const auto exit_code = static_cast<std::int32_t>(_exit_code);
+            std::memcpy(reply + 1, &exit_code, sizeof(exit_code));
+
+            write_all(_fd, reply, sizeof(reply));
+        }
+
+        // The socket of the command in progress, which SIGINT is forwarded to.
+        inline volatile std::sig_atomic_t interrupt_fd = -1;
+        inline volatile std::sig_atomic_t interrupt_sent = 0;
+
+        extern "C" inline void forward_interrupt(int)
+        {
+            if (const int fd = interrupt_fd; fd >= 0) {
+                const char c = 0;
+                [[maybe_unused]] const auto n = ::send(fd, &c, 1, MSG_NOSIGNAL);
+                interrupt_sent = 1;
+            }
+        }
+
+        // Reproduces the client's view of the local system for a command.
+        inline auto adopt_client_context(const request& _req) -> bool
+        {
+            if (::chdir(_req.cwd.c_str()) != 0) {
+                return false;
+            }
+
+            ::umask(static_cast<mode_t>(_req.umask & 0777));
+            ::clearenv();
+
+            for (auto&& e : _req.environment) {
+                if (const auto eq = e.find('='); eq != std::string::npos && eq > 0) {
+                    ::setenv(e.substr(0, eq).c_str(), e.c_str() + eq + 1, 1);
+                }
+            }
+
+            return true;
+        }
+
+        // Flushes everything the command wrote and detaches the process from the
+        // client's streams, so that the client sees the end of its pipes once the
+        // command has finished.
+        inline auto detach_streams(int _null_fd) -> void
+        {
+            std::cout.flush();
+            std::cerr.flush();
+            std::fflush(nullptr);
+
+            for (int fd : {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO}) {
+                ::dup2(_null_fd, fd);
+            }
+
+            // Input buffered from this client must not be seen by the next one.
+            __fpurge(stdin);
+            std::clearerr(stdin);
+            std::cin.clear();
+        }
+
+        template <typename FindCommand>
+        class worker
+        {
+        public:
+            worker(const rodsEnv& _env, const options& _options, FindCommand _find)
+                : identity_{agent::identity(_env)}
+                , runner_{_env, _options.connections, std::move(_find)}
+                , null_fd_{::open("/dev/null", O_RDWR | O_CLOEXEC)}
+            {
+            }
+
+            [[noreturn]] auto run(int _listener) -> void
+            {
+                ::signal(SIGINT, SIG_DFL);
+                ::signal(SIGPIPE, SIG_IGN);
+
+                load_client_api_plugins();
+                runner_.warm_up();
+
+                for (;;) {
+                    const auto fd = ::accept4(_listener, nullptr, nullptr, SOCK_CLOEXEC);
+
+                    if (fd < 0) {
+                        if (errno == EINTR || errno == ECONNABORTED) {
+                            continue;
+                        }
+
+                        std::_Exit(1);
+                    }
+
+                    descriptor connection{fd};
+
+                    if (!serve(connection.get())) {
+                        std::_Exit(0);
+                    }
+                }
+            }
+
+        private:
+            // Runs a single request. Returns false if the worker must be replaced.
+            auto serve(int _fd) -> bool
+            {
+                if (!same_user(_fd)) {
+                    return true;
+                }
+
+                int streams[3]{-1, -1, -1};
+                request req;
+                const auto received = receive_request(_fd, streams, req);
+                const descriptor in{streams[0]}, out{streams[1]}, err{streams[2]};
+
+                if (!received) {
+                    return true;
+                }
+
+                auto* cli = req.identity == identity_ && !req.args.empty() ? runner_.find(req.args.front()) : nullptr;
+
+                if (!cli || !adopt_client_context(req)) {
+                    send_reply(_fd, reply_status::rejected, 0);
+                    return true;
+                }
+
+                ::dup2(in.get(), STDIN_FILENO);
+                ::dup2(out.get(), STDOUT_FILENO);
+                ::dup2(err.get(), STDERR_FILENO);
+
+                // A byte from the client, or the client going away, interrupts the
+                // command as Ctrl-C would have done.
+                std::atomic<bool> finished{false};
+                std::atomic<bool> interrupted{false};
+
+                std::thread watcher{[_fd, &finished, &interrupted] {
+                    char c;
+                    ssize_t n;
+
+                    do {
+                        n = ::read(_fd, &c, 1);
+                    } while (n < 0 && errno == EINTR);
+
+                    if (!finished.load()) {
+                        interrupted.store(true);
+                        ::kill(::getpid(), SIGINT);
+                    }
+                }};
+
+                const auto ec = runner_.run(*cli, {std::next(std::begin(req.args)), std::end(req.args)});
+
+                finished.store(true);
+                ::shutdown(_fd, SHUT_RD);
+                watcher.join();
+
+                detach_streams(null_fd_.get());
+                send_reply(_fd, reply_status::executed, ec);
+
+                return !interrupted.load();
+            }
+
+            static auto same_user(int _fd) -> bool
+            {
+                ucred peer;
+                socklen_t size = sizeof(peer);
+                return ::getsockopt(_fd, SOL_SOCKET, SO_PEERCRED, &peer, &size) == 0 && peer.uid == ::getuid();
+            }
+
+            const std::string identity_;
+            command_runner<FindCommand> runner_;
+            const descriptor null_fd_;
+        }; // class worker
+    } // namespace detail
+
+    // Runs the command described by _args (the command name followed by its
+    // arguments) in the agent for _env. Returns the exit code of the command,
+    // or nothing if there is no agent or it cannot run the command, in which
+    // case the caller runs the command itself. Setting IRODS_CLI_AGENT to 0
+    // disables the agent.
+    inline auto execute(const rodsEnv& _env, const std::vector<std::string>& _args) -> std::optional<int>
+    {
+        if (const char* v = std::getenv("IRODS_CLI_AGENT"); v && std::strcmp(v, "0") == 0) {
+            return std::nullopt;
+        }
+
+        const auto path = socket_path(_env);
+
+        if (path.empty()) {
+            return std::nullopt;
+        }
+
+        const detail::descriptor connection{detail::connect_to(path)};
+
+        if (connection.get() < 0) {
+            return std::nullopt;
+        }
+
+        detail::request req;
+        req.umask = ::umask(022);
+        ::umask(static_cast<mode_t>(req.umask));
+        req.identity = identity(_env);
+        req.args = _args;
+
+        if (char cwd[PATH_MAX]; ::getcwd(cwd, sizeof(cwd))) {
+            req.cwd = cwd;
+        }
+        else {
+            return std::nullopt;
+        }
+
+        for (auto** e = environ; e && *e; ++e) {
+            req.environment.emplace_back(*e);
+        }
+
+        if (!detail::send_request(connection.get(), detail::encode(req))) {
+            return std::nullopt;
+        }
+
+        detail::interrupt_fd = connection.get();
+        auto* previous = ::signal(SIGINT, detail::forward_interrupt);
+
+        char reply[1 + sizeof(std::int32_t)];
+        const auto received = detail::read_all(connection.get(), reply, sizeof(reply));
+
+        ::signal(SIGINT, previous);
+        detail::interrupt_fd = -1;
+
+        if (!received) {
+            // Commands without a handler for SIGINT end with their worker.
+            if (detail::interrupt_sent) {
+                return 128 + SIGINT;
+            }
+
+            std::cerr << "Error: Lost connection to the agent.\n";
+            return 1;
+        }
+
+        if (static_cast<detail::reply_status>(reply[0]) == detail::reply_status::rejected) {
+            return std::nullopt;
+        }
+
+        std::int32_t exit_code;
+        std::memcpy(&exit_code, reply + 1, sizeof(exit_code));
+
+        return exit_code;
+    }
+
+    // Serves commands until SIGINT or SIGTERM. _find(name) returns a pointer
+    // (e.g. a shared_ptr) to the command with the given name, or null.
+    template <typename FindCommand>
+    auto serve(const rodsEnv& _env, const options& _options, FindCommand _find) -> int
+    {
+        const auto path = socket_path(_env);
+        sockaddr_un addr;
+
+        if (path.empty()) {
+            std::cerr << "Error: The agent requires HOME to be set.\n";
+            return 1;
+        }
+
+        if (!detail::make_address(path, addr)) {
+            std::cerr << "Error: The agent socket path is too long [path: " << path << "].\n";
+            return 1;
+        }
+
+        if (const detail::descriptor other{detail::connect_to(path)}; other.get() >= 0) {
+            std::cerr << "Error: An agent is already running [path: " << path << "].\n";
+            return 1;
+        }
+
+        const auto directory = path.substr(0, path.rfind('/'));
+        ::mkdir(directory.c_str(), 0700);
+        ::unlink(path.c_str());
+
+        const detail::descriptor listener{::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)};
+
+        if (listener.get() < 0 ||
+            ::bind(listener.get(), reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0 ||
+            ::chmod(path.c_str(), 0600) != 0 ||
+            ::listen(listener.get(), SOMAXCONN) != 0)
+        {
+            std::cerr << "Error: Cannot listen on the agent socket [path: " << path << ", error: " << std::strerror(errno) << "].\n";
+            return 1;
+        }
+
+        // Signals are only handled by sigwait() below. Workers restore the
+        // original mask.
+        sigset_t signals, original;
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGINT);
+        sigaddset(&signals, SIGTERM);
+        sigaddset(&signals, SIGCHLD);
+        ::sigprocmask(SIG_BLOCK, &signals, &original);
+
+        using clock_type = std::chrono::steady_clock;
+        std::map<pid_t, clock_type::time_point> workers;
+
+        const auto spawn = [&] {
+            const auto pid = ::fork();
+
+            if (pid == 0) {
+                ::sigprocmask(SIG_SETMASK, &original, nullptr);
+                detail::worker<FindCommand>{_env, _options, _find}.run(listener.get());
+            }
+
+            if (pid > 0) {
+                workers.emplace(pid, clock_type::now());
+            }
+        };
+
+        for (int i = 0; i < _options.workers; ++i) {
+            spawn();
+        }
+
+        std::cout << "Listening on " << path << " with " << workers.size() << " workers.\n" << std::flush;
+
+        for (int sig = 0; ::sigwait(&signals, &sig) == 0 && sig == SIGCHLD;) {
+            for (pid_t pid; (pid = ::waitpid(-1, nullptr, WNOHANG)) > 0;) {
+                const auto iter = workers.find(pid);
+
+                if (iter == std::end(workers)) {
+                    continue;
+                }
+
+                // Keeps a worker that cannot start from being restarted in a loop.
+                if (clock_type::now() - iter->second < std::chrono::seconds{1}) {
+                    std::this_thread::sleep_for(std::chrono::seconds{1});
+                }
+
+                workers.erase(iter);
+                spawn();
+            }
+        }
+
+        ::unlink(path.c_str());
+
+        for (auto&& [pid, started] : workers) {
+            ::kill(pid, SIGTERM);
+        }
+
+        for (auto&& [pid, started] : workers) {
+            ::waitpid(pid, nullptr, 0);
+        }
+
+        ::sigprocmask(SIG_SETMASK, &original, nullptr);
+
+        return 0;
+    }
+} // namespace irods::cli::agent
+
+#endif // IRODS_CLI_AGENT_HPP
@@ -0,0 +1,407 @@
+#ifndef IRODS_CLI_BATCH_HPP
+#define IRODS_CLI_BATCH_HPP
+
+#include "command_runner.hpp"
+
+#include <irods/rodsClient.h>
+
+#include <boost/program_options/parsers.hpp>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Batch mode (irods batch) runs a sequence of commands, one per line, without
+// starting irods for each of them: plugins are loaded once and the commands of
+// a job share one session of connections. Lines are split like a shell would
+// split them, and empty lines and lines starting with # are skipped. For
+// example:
+//
+//   touch /tempZone/home/alice/a
+//   ls -l "/tempZone/home/alice/with spaces"
+//   # Comments are ignored.
+//   rm -f /tempZone/home/alice/a
+//
+// Commands keep state in their (single) instances and write to the standard
+// streams of the process, so lines cannot run on several threads. Instead, the
+// irods process reads the lines and hands them out to one worker process per
+// job, each of which runs its lines one after another with its own session.
+// The output of concurrent lines may interleave, as with xargs -P. Workers
+// read stdin from /dev/null when the lines come from stdin, and each command
+// starts with the signal dispositions the worker had before it.
+//
+// SIGINT stops the batch: no further lines are handed out, and lines that were
+// interrupted count as failed. Ctrl-C also reaches the commands in progress,
+// which are in the same process group.
+//
+// Every line that fails is reported on stderr. The report, if requested, lists
+// the exit code of every line as "<line number> TAB <exit code>", in the order
+// in which the lines finish.
+namespace irods::cli::batch
+{
+    struct options
+    {
+        // The number of lines that can run at the same time.
+        int jobs = 1;
+
+        // The maximum number of connections of each job.
+        int connections = 4;
+
+        // Where the exit code of every line is written. Empty if not requested.
+        std::string report;
+
+        // Whether the commands are read from stdin, which is then not available
+        // to the commands themselves.
+        bool input_is_stdin = true;
+    }; // struct options
+
+    namespace detail
+    {
+        class reporter
+        {
+        public:
+            explicit reporter(const std::string& _path)
+            {
+                if (!_path.empty()) {
+                    report_.emplace(_path);
+
+                    if (!*report_) {
+                        throw std::runtime_error{"Cannot open report [path: " + _path + "]."};
+                    }
+                }
+            }
+
+            auto record(std::size_t _line_number, int _ec) -> void
+            {
+                if (_ec != 0) {
+                    ++failures_;
+                    std::cerr << "Error: Line " << _line_number << " failed [exit code: " << _ec << "].\n";
+                }
+
+                if (report_) {
+                    *report_ << _line_number << '\t' << _ec << '\n' << std::flush;
+                }
+            }
+
+            auto failures() const noexcept -> std::size_t
+            {
+                return failures_;
+            }
+
+        private:
+            std::optional<std::ofstream> report_;
+            std::size_t failures_ = 0;
+        }; // class reporter
+
+        inline auto is_command(const std::string& _line) -> bool
+        {
+            const auto first = _line.find_first_not_of(" \t\r");
+            return first != std::string::npos && _line[first] != '#';
+        }
+
+        // Runs the command on a line and returns its exit code.
+        template <typename FindCommand>
+        auto run_line(command_runner<FindCommand>& _runner, std::size_t _line_number, const std::string& _line) -> int
+        {
+            std::vector<std::string> args;
+
+            try {
+                args = boost::program_options::split_unix(_line, " \t\r");
+            }
+            catch (const std::exception& e) {
+                std::cerr << "Error: Cannot parse line " << _line_number << " [error: " << e.what() << "].\n";
+                return 1;
+            }
+
+            if (args.empty()) {
+                return 0;
+            }
+
+            auto* cli = _runner.find(args.front());
+
+            if (!cli) {
+                std::cout << "Invalid command: " << args.front() << '\n';
+                return 1;
+            }
+
+            args.erase(std::begin(args));
+
+            const auto ec = _runner.run(*cli, args);
+
+            std::cout.flush();
+            std::cerr.flush();
+            std::fflush(nullptr);
+
+            return ec;
+        }
+
+        inline auto write_all(int _fd, const std::string& _data) -> bool
+        {
+            const char* p = _data.data();
+            auto remaining = _data.size();
+
+            while (remaining > 0) {
+                const auto n = ::write(_fd, p, remaining);
+
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+
+                if (n <= 0) {
+                    return false;
+                }
+
+                p += n;
+                remaining -= static_cast<std::size_t>(n);
+            }
+
+            return true;
+        }
+
+        // Runs the lines sent by the parent over _tasks ("<line number> TAB
+        // <line>") and answers every line with "<job> <line number> <exit code>"
+        // over _results. Answers are shorter than PIPE_BUF, so the answers of all
+        // jobs can share a single pipe.
+        template <typename FindCommand>
+        [[noreturn]] auto run_job(int _job, int _tasks, int _results, const rodsEnv& _env, const options& _options, FindCommand _find)
+            -> void
+        {
+            if (_options.input_is_stdin) {
+                if (const auto fd = ::open("/dev/null", O_RDONLY); fd >= 0) {
+                    ::dup2(fd, STDIN_FILENO);
+                    ::close(fd);
+                }
+            }
+
+            load_client_api_plugins();
+
+            command_runner<FindCommand> runner{_env, _options.connections, std::move(_find)};
+            runner.warm_up();
+
+            auto* tasks = ::fdopen(_tasks, "r");
+            char* buffer = nullptr;
+            std::size_t capacity = 0;
+
+            for (ssize_t n; (n = ::getline(&buffer, &capacity, tasks)) > 0;) {
+                std::string task{buffer, static_cast<std::size_t>(n - 1)};
+                const auto tab = task.find('\t');
+                const auto line_number = std::stoul(task.substr(0, tab));
+                const auto ec = run_line(runner, line_number, task.substr(tab + 1));
+
+                write_all(_results, std::to_string(_job) + ' ' + std::to_string(line_number) + ' ' + std::to_string(ec) + '\n');
+            }
+
+            std::_Exit(0);
+        }
+
+        // Set by SIGINT. The jobs are in the same process group, so Ctrl-C
+        // reaches their commands directly; forwarding it as well could hit a job
+        // between two commands and kill it before it reports its line.
+        inline volatile std::sig_atomic_t interrupted = 0;
+
+        inline auto interrupt(int) -> void
+        {
+            interrupted = 1;
+        }
+
+        // Runs the lines on _options.jobs worker processes. Returns false if the
+        // batch was interrupted.
+        template <typename FindCommand>
+        auto run_jobs(std::istream& _in, const rodsEnv& _env, const options& _options, FindCommand _find, reporter& _report)
+            -> bool
+        {
+            struct job
+            {
+                pid_t pid = -1;
+
+                // Where lines are sent to, or -1 once the job has exited.
+                int tasks = -1;
+
+                // The line in progress.
+                std::optional<std::size_t> line_number;
+            }; // struct job
+
+            int results[2];
+
+            if (::pipe2(results, O_CLOEXEC) != 0) {
+                throw std::runtime_error{"Cannot create pipe."};
+            }
+
+            const auto old_sigpipe = ::signal(SIGPIPE, SIG_IGN);
+
+            // Output buffered before the fork would be written by every job.
+            std::cout.flush();
+            std::cerr.flush();
+            std::fflush(nullptr);
+
+            std::vector<job> jobs(static_cast<std::size_t>(_options.jobs));
+
+            for (std::size_t i = 0; i < jobs.size(); ++i) {
+                int tasks[2];
+
+                if (::pipe2(tasks, O_CLOEXEC) != 0) {
+                    break;
+                }
+
+                const auto pid = ::fork();
+
+                if (pid == 0) {
+                    ::close(tasks[1]);
+                    ::close(results[0]);
+
+                    for (std::size_t j = 0; j < i; ++j) {
+                        ::close(jobs[j].tasks);
+                    }
+
+                    run_job(static_cast<int>(i), tasks[0], results[1], _env, _options, std::move(_find));
+                }
+
+                ::close(tasks[0]);
+
+                if (pid < 0) {
+                    ::close(tasks[1]);
+                    break;
+                }
+
+                jobs[i].pid = pid;
+                jobs[i].tasks = tasks[1];
+            }
+
+            ::close(results[1]);
+            auto* answers = ::fdopen(results[0], "r");
+
+            // Reads are restarted after the handler, so that an answer is never
+            // cut in half. A batch read from a terminal therefore only stops once
+            // the line being typed is complete.
+            interrupted = 0;
+
+            struct sigaction action{};
+            struct sigaction old_sigint{};
+            action.sa_handler = interrupt;
+            action.sa_flags = SA_RESTART;
+            ::sigemptyset(&action.sa_mask);
+            ::sigaction(SIGINT, &action, &old_sigint);
+
+            // Jobs that exit without answering, e.g. because they crashed, fail
+            // the line they were running.
+            const auto fail_unfinished = [&_report](job& _job) {
+                if (_job.line_number) {
+                    _report.record(*_job.line_number, 1);
+                    _job.line_number.reset();
+                }
+
+                if (_job.tasks >= 0) {
+                    ::close(_job.tasks);
+                    _job.tasks = -1;
+                }
+            };
+
+            // Waits for the next answer. Returns false once every job has exited.
+            const auto collect = [&] {
+                int index;
+                std::size_t line_number;
+                int ec;
+
+                if (std::fscanf(answers, "%d %zu %d", &index, &line_number, &ec) != 3) {
+                    std::for_each(std::begin(jobs), std::end(jobs), fail_unfinished);
+                    return false;
+                }
+
+                jobs[static_cast<std::size_t>(index)].line_number.reset();
+                _report.record(line_number, ec);
+
+                return true;
+            };
+
+            std::string line;
+
+            for (std::size_t line_number = 1; !interrupted && std::getline(_in, line); ++line_number) {
+                if (!is_command(line)) {
+                    continue;
+                }
+
+                while (!interrupted) {
+                    auto idle = std::find_if(std::begin(jobs), std::end(jobs), [](const job& _j) {
+                        return _j.tasks >= 0 && !_j.line_number;
+                    });
+
+                    if (idle == std::end(jobs)) {
+                        if (std::none_of(std::begin(jobs), std::end(jobs), [](const job& _j) { return _j.tasks >= 0; })) {
+                            std::cerr << "Error: No job is left to run line " << line_number << ".\n";
+                            _report.record(line_number, 1);
+                            break;
+                        }
+
+                        collect();
+                        continue;
+                    }
+
+                    if (write_all(idle->tasks, std::to_string(line_number) + '\t' + line + '\n')) {
+                        idle->line_number = line_number;
+                        break;
+                    }
+
+                    fail_unfinished(*idle);
+                }
+            }
+
+            // Jobs exit once they have run every line sent to them.
+            for (auto&& j : jobs) {
+                if (j.tasks >= 0) {
+                    ::close(j.tasks);
+                    j.tasks = -1;
+                }
+            }
+
+            while (collect()) {
+            }
+
+            std::fclose(answers);
+
+            for (auto&& j : jobs) {
+                if (j.pid > 0) {
+                    ::waitpid(j.pid, nullptr, 0);
+                }
+            }
+
+            ::sigaction(SIGINT, &old_sigint, nullptr);
+            ::signal(SIGPIPE, old_sigpipe);
+
+            return !interrupted;
+        }
+    } // namespace detail
+
+    // Runs the commands read from _in. Returns 0 if every command succeeded,
+    // and 130 if the batch was interrupted.
+    template <typename FindCommand>
+    auto run(std::istream& _in, const rodsEnv& _env, const options& _options, FindCommand _find) -> int
+    {
+        detail::reporter report{_options.report};
+
+        if (!detail::run_jobs(_in, _env, _options, std::move(_find), report)) {
+            std::cerr << "Error: Interrupted. Remaining lines were not run.\n";
+            return 130;
+        }
+
+        return report.failures() == 0 ? 0 : 1;
+    }
+} // namespace irods::cli::batch
+
+#endif // IRODS_CLI_BATCH_HPP
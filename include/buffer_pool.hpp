@@ -0,0 +1,221 @@
+#ifndef IRODS_CLI_BUFFER_POOL_HPP
+#define IRODS_CLI_BUFFER_POOL_HPP
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace irods::cli
+{
+    // A pool of page-aligned transfer buffers shared by every worker of a
+    // command. Buffers are allocated on first use, handed back to the pool when
+    // released, and never zero-filled. The total amount of memory owned by the
+    // pool never exceeds the limit given at construction; callers block until a
+    // buffer is returned once the limit has been reached.
+    class buffer_pool
+    {
+    public:
+        class buffer
+        {
+        public:
+            buffer() noexcept = default;
+
+            buffer(buffer&& _other) noexcept
+                : pool_{std::exchange(_other.pool_, nullptr)}
+                , data_{std::exchange(_other.data_, nullptr)}
+            {
+            }
+
+            auto operator=(buffer&& _other) noexcept -> buffer&
+            {
+                if (this != &_other) {
+                    release();
+                    pool_ = std::exchange(_other.pool_, nullptr);
+                    data_ = std::exchange(_other.data_, nullptr);
+                }
+
+                return *this;
+            }
+
+            ~buffer()
+            {
+                release();
+            }
+
+            auto data() const noexcept -> char*
+            {
+                return data_;
+            }
+
+            auto size() const noexcept -> std::size_t
+            {
+                return pool_ ? pool_->buffer_size() : 0;
+            }
+
+            explicit operator bool() const noexcept
+            {
+                return data_ != nullptr;
+            }
+
+            auto release() noexcept -> void
+            {
+                if (pool_ && data_) {
+                    pool_->give_back(data_);
+                }
+
+                pool_ = nullptr;
+                data_ = nullptr;
+            }
+
+        private:
+            friend class buffer_pool;
+
+            buffer(buffer_pool* _pool, char* _data) noexcept
+                : pool_{_pool}
+                , data_{_data}
+            {
+            }
+
+            buffer_pool* pool_ = nullptr;
+            char* data_ = nullptr;
+        }; // class buffer
+
+        buffer_pool(std::size_t _buffer_size, std::size_t _memory_limit)
+            : alignment_{page_size()}
+            , buffer_size_{round_up(std::max<std::size_t>(_buffer_size, 1), alignment_)}
+            , max_buffers_{std::max<std::size_t>(_memory_limit / buffer_size_, 1)}
+        {
+        }
+
+        buffer_pool(const buffer_pool&) = delete;
+        auto operator=(const buffer_pool&) -> buffer_pool& = delete;
+
+        ~buffer_pool()
+        {
+            for (auto* p : free_) {
+                std::free(p);
+            }
+        }
+
+        // Borrows a buffer, waiting for one to be returned if the memory limit
+        // has been reached.
+        auto acquire() -> buffer
+        {
+            std::unique_lock lk{mtx_};
+            cv_.wait(lk, [this] { return !free_.empty() || allocated_ < max_buffers_; });
+            return take(lk);
+        }
+
+        // Borrows a buffer without waiting. Returns an empty buffer if none is
+        // available and the memory limit has been reached.
+        auto try_acquire() -> buffer
+        {
+            std::unique_lock lk{mtx_};
+
+            if (free_.empty() && allocated_ >= max_buffers_) {
+                return {};
+            }
+
+            return take(lk);
+        }
+
+        // Borrows up to _count buffers. Only the first one is waited for; the
+        // others are taken if the pool can spare them, so that callers holding
+        // several buffers each cannot deadlock on the memory limit.
+        auto acquire_batch(std::size_t _count) -> std::vector<buffer>
+        {
+            std::vector<buffer> buffers;
+            buffers.push_back(acquire());
+
+            while (buffers.size() < _count) {
+                if (auto b = try_acquire(); b) {
+                    buffers.push_back(std::move(b));
+                }
+                else {
+                    break;
+                }
+            }
+
+            return buffers;
+        }
+
+        auto buffer_size() const noexcept -> std::size_t
+        {
+            return buffer_size_;
+        }
+
+        auto max_buffers() const noexcept -> std::size_t
+        {
+            return max_buffers_;
+        }
+
+    private:
+        static auto page_size() noexcept -> std::size_t
+        {
+            const auto n = ::sysconf(_SC_PAGESIZE);
+            return n > 0 ? static_cast<std::size_t>(n) : 4096;
+        }
+
+        static auto round_up(std::size_t _n, std::size_t _multiple) noexcept -> std::size_t
+        {
+            return (_n + _multiple - 1) / _multiple * _multiple;
+        }
+
+        auto take(std::unique_lock<std::mutex>& _lk) -> buffer
+        {
+            if (!free_.empty()) {
+                auto* p = free_.back();
+                free_.pop_back();
+                return {this, p};
+            }
+
+            // Keeping the free list large enough for every buffer ever allocated
+            // guarantees that returning a buffer never has to allocate.
+            free_.reserve(allocated_ + 1);
+            ++allocated_;
+            _lk.unlock();
+
+            void* p = nullptr;
+
+            if (::posix_memalign(&p, alignment_, buffer_size_) != 0) {
+                give_back(nullptr);
+                throw std::bad_alloc{};
+            }
+
+            return {this, static_cast<char*>(p)};
+        }
+
+        auto give_back(char* _p) noexcept -> void
+        {
+            {
+                std::lock_guard lk{mtx_};
+
+                if (_p) {
+                    free_.push_back(_p);
+                }
+                else {
+                    --allocated_;
+                }
+            }
+
+            cv_.notify_one();
+        }
+
+        const std::size_t alignment_;
+        const std::size_t buffer_size_;
+        const std::size_t max_buffers_;
+        std::size_t allocated_ = 0;
+        std::vector<char*> free_;
+        std::mutex mtx_;
+        std::condition_variable cv_;
+    }; // class buffer_pool
+} // namespace irods::cli
+
+#endif // IRODS_CLI_BUFFER_POOL_HPP
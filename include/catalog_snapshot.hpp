@@ -0,0 +1,49 @@
+#ifndef IRODS_CLI_CATALOG_SNAPSHOT_HPP
+#define IRODS_CLI_CATALOG_SNAPSHOT_HPP
+
+#include "genquery.hpp"
+
+#include <irods/rodsClient.h>
+#include <irods/irods_query.hpp>
+
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <unordered_map>
+
+namespace irods::cli
+{
+    struct catalog_entry
+    {
+        std::uintmax_t size;
+        std::time_t mtime;
+        std::string checksum;
+    };
+
+    // The data objects of a single collection, keyed by name.
+    using catalog_snapshot = std::unordered_map<std::string, catalog_entry>;
+
+    // Fetches size, mtime and checksum of every good replica in a collection with
+    // a single GenQuery, instead of one status call per data object.
+    inline auto fetch_catalog_snapshot(rcComm_t& _comm, const std::string& _collection) -> catalog_snapshot
+    {
+        catalog_snapshot snapshot;
+
+        const auto gql = "select DATA_NAME, DATA_SIZE, DATA_MODIFY_TIME, DATA_CHECKSUM "
+                         "where COLL_NAME = '" + genquery_literal(_collection) + "' and DATA_REPL_STATUS = '1'";
+
+        for (auto&& row : irods::query<rcComm_t>{&_comm, gql}) {
+            auto& e = snapshot[row[0]];
+            e.size = std::stoull(row[1]);
+            e.mtime = static_cast<std::time_t>(std::stoll(row[2]));
+
+            if (e.checksum.empty()) {
+                e.checksum = row[3];
+            }
+        }
+
+        return snapshot;
+    }
+} // namespace irods::cli
+
+#endif // IRODS_CLI_CATALOG_SNAPSHOT_HPP
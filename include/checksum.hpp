@@ -0,0 +1,298 @@
+#ifndef IRODS_CLI_CHECKSUM_HPP
+#define IRODS_CLI_CHECKSUM_HPP
+
+#include "buffer_pool.hpp"
+
+#include <openssl/evp.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <array>
+#include <cerrno>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+namespace irods::cli
+{
+    // Incremental SHA-256 in the format iRODS stores in the catalog
+    // ("sha2:" followed by the base64 encoded digest). OpenSSL dispatches to the
+    // SHA extensions or AVX2 kernels of the running CPU.
+    class sha256
+    {
+    public:
+        sha256()
+            : ctx_{EVP_MD_CTX_new(), &EVP_MD_CTX_free}
+        {
+            if (!ctx_ || EVP_DigestInit_ex(ctx_.get(), EVP_sha256(), nullptr) != 1) {
+                throw std::runtime_error{"Cannot initialize SHA-256 context."};
+            }
+        }
+
+        auto update(const char* _data, std::size_t _size) -> void
+        {
+            if (_size > 0 && EVP_DigestUpdate(ctx_.get(), _data, _size) != 1) {
+                throw std::runtime_error{"Cannot update SHA-256 context."};
+            }
+        }
+
+        // Returns the checksum in iRODS format. The object cannot be updated
+        // afterwards.
+        auto final() -> std::string
+        {
+            std::array<unsigned char, EVP_MAX_MD_SIZE> digest{};
+            unsigned int length = 0;
+
+            if (EVP_DigestFinal_ex(ctx_.get(), digest.data(), &length) != 1) {
+                throw std::runtime_error{"Cannot finalize SHA-256 context."};
+            }
+
+            std::array<unsigned char, 4 * ((EVP_MAX_MD_SIZE + 2) / 3) + 1> encoded{};
+            const auto n = EVP_EncodeBlock(encoded.data(), digest.data(), static_cast<int>(length));
+
+            return "sha2:" + std::string{reinterpret_cast<const char*>(encoded.data()), static_cast<std::size_t>(n)};
+        }
+
+    private:
+        std::unique_ptr<EVP_MD_CTX, decltype(&EVP_MD_CTX_free)> ctx_;
+    }; // class sha256
+
+    // SHA-256 of a file whose pieces are read by several workers in no
+    // particular order, e.g. the ranges of a parallel upload. SHA-256 cannot
+    // combine digests of separate ranges, so the pieces are hashed in file
+    // order by run(), on a thread of its own.
+    //
+    // Workers hand over each piece they have read with update(), which copies
+    // it into a buffer of the pool and never waits for the digest. Pieces
+    // that arrive ahead of the hashed prefix are kept until it catches up, in
+    // at most _window buffers. Pieces that do not fit, and ranges that are not
+    // read by any worker (see skip()), are read from the file again when
+    // their turn comes, so memory stays bounded without stalling the workers.
+    // The buffer used for those reads is borrowed up front, so that hashing
+    // can always make progress while the window holds the pool's last buffers.
+    class reordering_sha256
+    {
+    public:
+        reordering_sha256(buffer_pool& _buffers, std::uintmax_t _size, std::size_t _window)
+            : buffers_{_buffers}
+            , size_{_size}
+            , window_{_window}
+            , scratch_{_buffers.acquire()}
+        {
+        }
+
+        reordering_sha256(const reordering_sha256&) = delete;
+        auto operator=(const reordering_sha256&) -> reordering_sha256& = delete;
+
+        // Hands over the bytes of the file at [_offset, _offset + _size).
+        auto update(std::uintmax_t _offset, const char* _data, std::size_t _size) -> void
+        {
+            bool reserved = false;
+
+            {
+                std::lock_guard lk{mtx_};
+
+                if (aborted_) {
+                    return;
+                }
+
+                if (buffered_ < window_) {
+                    ++buffered_;
+                    reserved = true;
+                }
+            }
+
+            buffer_pool::buffer copy;
+
+            if (reserved) {
+                copy = buffers_.try_acquire();
+            }
+
+            if (copy && _size <= copy.size()) {
+                std::memcpy(copy.data(), _data, _size);
+            }
+            else {
+                copy.release();
+            }
+
+            add(_offset, _size, std::move(copy), reserved);
+        }
+
+        // Declares that the bytes at [_offset, _offset + _size) are not handed
+        // over, so that run() reads them itself.
+        auto skip(std::uintmax_t _offset, std::uintmax_t _size) -> void
+        {
+            add(_offset, _size, {}, false);
+        }
+
+        // Makes run() return early, e.g. because the transfer failed.
+        auto abort() -> void
+        {
+            {
+                std::lock_guard lk{mtx_};
+                aborted_ = true;
+                pieces_.clear();
+            }
+
+            cv_.notify_all();
+        }
+
+        // Hashes the pieces in file order as they arrive, reading those that
+        // were not handed over from the file at _path. Returns the checksum in
+        // iRODS format, or an empty string if aborted.
+        auto run(const std::string& _path) -> std::string
+        {
+            try {
+                return hash_in_order(_path);
+            }
+            catch (...) {
+                abort();
+                throw;
+            }
+        }
+
+    private:
+        struct piece
+        {
+            std::uintmax_t size = 0;
+
+            // Empty if the piece has to be read from the file.
+            buffer_pool::buffer data;
+
+            // Whether the piece holds one of the _window slots.
+            bool counted = false;
+        }; // struct piece
+
+        auto add(std::uintmax_t _offset, std::uintmax_t _size, buffer_pool::buffer _data, bool _counted) -> void
+        {
+            {
+                std::lock_guard lk{mtx_};
+
+                if (aborted_) {
+                    return;
+                }
+
+                pieces_.insert_or_assign(_offset, piece{_size, std::move(_data), _counted});
+            }
+
+            cv_.notify_all();
+        }
+
+        auto hash_in_order(const std::string& _path) -> std::string
+        {
+            sha256 hasher;
+            int fd = -1;
+            std::uintmax_t hashed = 0;
+
+            const auto close_file = [&fd] {
+                if (fd >= 0) {
+                    ::close(fd);
+                }
+            };
+
+            try {
+                while (hashed < size_) {
+                    piece p;
+
+                    {
+                        std::unique_lock lk{mtx_};
+                        cv_.wait(lk, [this, hashed] { return aborted_ || (!pieces_.empty() && pieces_.begin()->first == hashed); });
+
+                        if (aborted_) {
+                            close_file();
+                            return {};
+                        }
+
+                        p = std::move(pieces_.begin()->second);
+                        pieces_.erase(pieces_.begin());
+
+                        if (p.counted) {
+                            --buffered_;
+                        }
+                    }
+
+                    if (p.data) {
+                        hasher.update(p.data.data(), static_cast<std::size_t>(p.size));
+                        hashed += p.size;
+                        continue;
+                    }
+
+                    if (fd < 0) {
+                        fd = ::open(_path.c_str(), O_RDONLY | O_CLOEXEC);
+
+                        if (fd < 0) {
+                            throw std::runtime_error{"Cannot open file for reading [path: " + _path + "]."};
+                        }
+                    }
+
+                    for (std::uintmax_t done = 0; done < p.size;) {
+                        const auto count = static_cast<std::size_t>(std::min<std::uintmax_t>(scratch_.size(), p.size - done));
+                        const auto n = ::pread(fd, scratch_.data(), count, static_cast<off_t>(hashed));
+
+                        if (n < 0 && errno == EINTR) {
+                            continue;
+                        }
+
+                        if (n <= 0) {
+                            throw std::runtime_error{"Cannot read file [path: " + _path + "]."};
+                        }
+
+                        hasher.update(scratch_.data(), static_cast<std::size_t>(n));
+                        done += static_cast<std::uintmax_t>(n);
+                        hashed += static_cast<std::uintmax_t>(n);
+                    }
+                }
+            }
+            catch (...) {
+                close_file();
+                throw;
+            }
+
+            close_file();
+
+            return hasher.final();
+        }
+
+        buffer_pool& buffers_;
+        const std::uintmax_t size_;
+        const std::size_t window_;
+        buffer_pool::buffer scratch_;
+
+        // The pieces handed over ahead of the hashed prefix, by offset.
+        std::map<std::uintmax_t, piece> pieces_;
+        std::size_t buffered_ = 0;
+        bool aborted_ = false;
+        std::mutex mtx_;
+        std::condition_variable cv_;
+    }; // class reordering_sha256
+
+    // Computes the iRODS checksum of a local file using the given scratch buffer.
+    inline auto file_checksum(const std::string& _path, char* _buffer, std::size_t _buffer_size) -> std::string
+    {
+        std::ifstream in{_path, std::ios_base::binary};
+
+        if (!in) {
+            throw std::runtime_error{"Cannot open file for reading [path: " + _path + "]."};
+        }
+
+        sha256 hasher;
+
+        while (in) {
+            in.read(_buffer, static_cast<std::streamsize>(_buffer_size));
+            hasher.update(_buffer, static_cast<std::size_t>(in.gcount()));
+        }
+
+        return hasher.final();
+    }
+} // namespace irods::cli
+
+#endif // IRODS_CLI_CHECKSUM_HPP
@@ -0,0 +1,81 @@
+#ifndef IRODS_CLI_CHUNK_SCHEDULER_HPP
+#define IRODS_CLI_CHUNK_SCHEDULER_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <optional>
+
+namespace irods::cli
+{
+    struct byte_range
+    {
+        std::uintmax_t offset;
+        std::uintmax_t size;
+    };
+
+    // Splits a file into many fixed-size byte ranges and hands them out to
+    // whichever worker asks next. Workers that finish early simply pull more
+    // ranges, so a single slow connection can never hold the others hostage.
+    class chunk_scheduler
+    {
+    public:
+        chunk_scheduler(std::uintmax_t _file_size, std::uintmax_t _chunk_size) noexcept
+            : file_size_{_file_size}
+            , chunk_size_{std::max<std::uintmax_t>(_chunk_size, 1)}
+            , chunk_count_{(file_size_ + chunk_size_ - 1) / chunk_size_}
+            , next_{0}
+        {
+        }
+
+        chunk_scheduler(const chunk_scheduler&) = delete;
+        auto operator=(const chunk_scheduler&) -> chunk_scheduler& = delete;
+
+        // Returns the next unclaimed range, or an empty optional once every
+        // range has been handed out. Safe to call from multiple threads.
+        auto next() noexcept -> std::optional<byte_range>
+        {
+            const auto i = next_.fetch_add(1, std::memory_order_relaxed);
+
+            if (i >= chunk_count_) {
+                return std::nullopt;
+            }
+
+            const auto offset = i * chunk_size_;
+            return byte_range{offset, std::min(chunk_size_, file_size_ - offset)};
+        }
+
+        auto file_size() const noexcept -> std::uintmax_t
+        {
+            return file_size_;
+        }
+
+        auto chunk_size() const noexcept -> std::uintmax_t
+        {
+            return chunk_size_;
+        }
+
+        auto chunk_count() const noexcept -> std::uintmax_t
+        {
+            return chunk_count_;
+        }
+
+        // Returns the number of workers worth starting for a transfer. There is
+        // no point in running more workers than there are ranges to process.
+        static auto worker_count(std::uintmax_t _file_size, std::uintmax_t _chunk_size, int _max_workers) noexcept
+            -> int
+        {
+            const chunk_scheduler s{_file_size, _chunk_size};
+            const auto n = std::min<std::uintmax_t>(s.chunk_count(), std::max(_max_workers, 1));
+            return static_cast<int>(std::max<std::uintmax_t>(n, 1));
+        }
+
+    private:
+        const std::uintmax_t file_size_;
+        const std::uintmax_t chunk_size_;
+        const std::uintmax_t chunk_count_;
+        std::atomic<std::uintmax_t> next_;
+    }; // class chunk_scheduler
+} // namespace irods::cli
+
+#endif // IRODS_CLI_CHUNK_SCHEDULER_HPP
@@ -0,0 +1,114 @@
+#ifndef IRODS_CLI_COLLECTION_LISTING_HPP
+#define IRODS_CLI_COLLECTION_LISTING_HPP
+
+#include "genquery.hpp"
+
+#include <irods/rodsClient.h>
+#include <irods/irods_query.hpp>
+
+#include <cstdint>
+#include <ctime>
+#include <string>
+
+namespace irods::cli
+{
+    // One replica of a data object, as shown by a long listing.
+    struct replica_entry
+    {
+        std::string name;
+        int replica_number;
+        std::string resource;
+        std::string owner;
+        std::uintmax_t size;
+        std::time_t mtime;
+        bool good;
+
+        // Only filled in for listing_detail::full.
+        std::string checksum;
+        std::string data_type;
+        std::string physical_path;
+    };
+
+    enum class listing_detail
+    {
+        basic,
+        full
+    };
+
+    namespace detail
+    {
+        template <typename Function>
+        auto for_each_replica_where(rcComm_t& _comm, const std::string& _condition, listing_detail _detail, Function& _func)
+            -> void
+        {
+            auto gql = std::string{"select DATA_NAME, DATA_REPL_NUM, DATA_RESC_NAME, DATA_OWNER_NAME, DATA_SIZE, "
+                                   "DATA_MODIFY_TIME, DATA_REPL_STATUS"};
+
+            if (_detail == listing_detail::full) {
+                gql += ", DATA_CHECKSUM, DATA_TYPE_NAME, DATA_PATH";
+            }
+
+            gql += " where " + _condition;
+
+            replica_entry e;
+
+            for (auto&& row : irods::query<rcComm_t>{&_comm, gql}) {
+                e.name = std::move(row[0]);
+                e.replica_number = std::stoi(row[1]);
+                e.resource = std::move(row[2]);
+                e.owner = std::move(row[3]);
+                e.size = std::stoull(row[4]);
+                e.mtime = static_cast<std::time_t>(std::stoll(row[5]));
+                e.good = row[6] == "1";
+
+                if (_detail == listing_detail::full) {
+                    e.checksum = std::move(row[7]);
+                    e.data_type = std::move(row[8]);
+                    e.physical_path = std::move(row[9]);
+                }
+
+                _func(e);
+            }
+        }
+    } // namespace detail
+
+    // Invokes _func for every replica of every data object in a collection.
+    // Everything a long listing needs comes from a single GenQuery, and rows
+    // are handed out as each page of results arrives, so the number of round
+    // trips depends on the number of pages, not on the number of entries.
+    template <typename Function>
+    auto for_each_replica(rcComm_t& _comm, const std::string& _collection, listing_detail _detail, Function _func) -> void
+    {
+        detail::for_each_replica_where(_comm, "COLL_NAME = '" + genquery_literal(_collection) + "'", _detail, _func);
+    }
+
+    // Invokes _func for every replica of a single data object.
+    template <typename Function>
+    auto for_each_replica_of(rcComm_t& _comm,
+                             const std::string& _collection,
+                             const std::string& _data_name,
+                             listing_detail _detail,
+                             Function _func) -> void
+    {
+        const auto condition = "COLL_NAME = '" + genquery_literal(_collection) + "' and DATA_NAME = '" +
+                               genquery_literal(_data_name) + "'";
+        detail::for_each_replica_where(_comm, condition, _detail, _func);
+    }
+
+    // Invokes _func with the absolute path of every direct subcollection of a
+    // collection.
+    template <typename Function>
+    auto for_each_subcollection(rcComm_t& _comm, const std::string& _collection, Function _func) -> void
+    {
+        const auto gql = "select COLL_NAME where COLL_PARENT_NAME = '" + genquery_literal(_collection) + "'";
+
+        for (auto&& row : irods::query<rcComm_t>{&_comm, gql}) {
+            // The root collection is its own parent.
+            if (row[0] != _collection) {
+                _func(row[0]);
+            }
+        }
+    }
+} // namespace irods::cli
+
+#endif // IRODS_CLI_COLLECTION_LISTING_HPP
@@ -1,6 +1,12 @@
 #ifndef IRODS_CLI_COMMAND_HPP
 #define IRODS_CLI_COMMAND_HPP
 
+#include "transfer_session.hpp"
+
+#include <boost/config.hpp>
+
+#include <optional>
+#include <string>
 #include <string_view>
 #include <vector>
 
@@ -18,8 +24,48 @@ namespace irods::cli
         virtual auto help_text() const noexcept -> std::string_view = 0;
 
         virtual auto execute(const std::vector<std::string>& args) -> int = 0;
+
+        // Lends the command a session to take its connections from, e.g. the
+        // warm connections of the agent. The session must outlive the calls to
+        // execute(). Passing nullptr makes the command connect on its own again.
+        auto attach(transfer_session* _session) noexcept -> void
+        {
+            session_ = _session;
+        }
+
+    protected:
+        // Returns the attached session, or constructs a new one in _own.
+        auto session_for(const rodsEnv& _env, int _max_connections, std::optional<transfer_session>& _own) -> transfer_session&
+        {
+            if (session_) {
+                return *session_;
+            }
+
+            return _own.emplace(_env, _max_connections);
+        }
+
+    private:
+        transfer_session* session_ = nullptr;
     };
 } // namespace irods::cli
 
-#endif // IRODS_CLI_COMMAND_HPP
+// Makes the command implemented by irods::cli::<type> available to the irods
+// executable. Plugins export the instance as "cli_impl", which is looked up
+// when the plugin is loaded. When commands are compiled into the executable
+// (IRODS_CLI_STATIC_COMMANDS), each one provides an accessor instead, which
+// the registry generated by CMakeLists.txt refers to. The instance is created
+// on first use.
+#ifdef IRODS_CLI_STATIC_COMMANDS
+    #define IRODS_CLI_COMMAND(type)                                \
+        auto irods_cli_command_##type() -> irods::cli::command&   \
+        {                                                          \
+            static irods::cli::type impl;                          \
+            return impl;                                           \
+        }
+#else
+    #define IRODS_CLI_COMMAND(type)                                \
+        extern "C" BOOST_SYMBOL_EXPORT irods::cli::type cli_impl; \
+        irods::cli::type cli_impl;
+#endif
 
+#endif // IRODS_CLI_COMMAND_HPP
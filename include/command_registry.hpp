@@ -0,0 +1,77 @@
+#ifndef IRODS_CLI_COMMAND_REGISTRY_HPP
+#define IRODS_CLI_COMMAND_REGISTRY_HPP
+
+#include "command.hpp"
+
+#include <array>
+#include <cstddef>
+#include <string_view>
+
+namespace irods::cli
+{
+    struct command_entry
+    {
+        std::string_view name;
+        auto (*get)() -> command&;
+    };
+
+    // The commands compiled into the executable, sorted by name. The table is
+    // a constant, so it needs neither dynamic initialization nor relocation
+    // processing beyond what the linker resolves, and names can be looked up
+    // at compile time as well as at run time.
+    template <std::size_t N>
+    class command_registry
+    {
+    public:
+        constexpr explicit command_registry(const std::array<command_entry, N>& _entries)
+            : entries_{_entries}
+        {
+        }
+
+        constexpr auto is_sorted() const noexcept -> bool
+        {
+            for (std::size_t i = 1; i < N; ++i) {
+                if (!(entries_[i - 1].name < entries_[i].name)) {
+                    return false;
+                }
+            }
+
+            return true;
+        }
+
+        // Returns the entry of the named command, or nullptr if there is none.
+        constexpr auto find(std::string_view _name) const noexcept -> const command_entry*
+        {
+            std::size_t first = 0;
+            std::size_t last = N;
+
+            while (first < last) {
+                const auto middle = first + (last - first) / 2;
+
+                if (entries_[middle].name < _name) {
+                    first = middle + 1;
+                }
+                else {
+                    last = middle;
+                }
+            }
+
+            return first < N && entries_[first].name == _name ? &entries_[first] : nullptr;
+        }
+
+        constexpr auto begin() const noexcept
+        {
+            return entries_.begin();
+        }
+
+        constexpr auto end() const noexcept
+        {
+            return entries_.end();
+        }
+
+    private:
+        std::array<command_entry, N> entries_;
+    }; // class command_registry
+} // namespace irods::cli
+
+#endif // IRODS_CLI_COMMAND_REGISTRY_HPP
@@ -0,0 +1,133 @@
+#ifndef IRODS_CLI_COMMAND_RUNNER_HPP
+#define IRODS_CLI_COMMAND_RUNNER_HPP
+
+#include "command.hpp"
+#include "transfer_session.hpp"
+
+#include <irods/rodsClient.h>
+
+#include <signal.h>
+
+#include <array>
+#include <cstddef>
+#include <exception>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace irods::cli
+{
+    // Runs many commands in one process, one at a time, with a session whose
+    // connections are kept from one command to the next. Used by the agent
+    // and by batch mode.
+    //
+    // Commands are looked up with _find(name), which returns a pointer (e.g. a
+    // shared_ptr) to the command with the given name or null, and are kept
+    // loaded afterwards.
+    template <typename FindCommand>
+    class command_runner
+    {
+    public:
+        command_runner(const rodsEnv& _env, int _max_connections, FindCommand _find)
+            : env_{_env}
+            , max_connections_{_max_connections}
+            , find_{std::move(_find)}
+        {
+        }
+
+        command_runner(const command_runner&) = delete;
+        auto operator=(const command_runner&) -> command_runner& = delete;
+
+        // Connects ahead of the first command, so that it is as fast as any
+        // other. The first connection reports failures, which are left to the
+        // command to run into; the others are opened in the background.
+        auto warm_up() -> void
+        {
+            try {
+                session().acquire();
+                session().warm_up(max_connections_);
+            }
+            catch (const std::exception& e) {
+                std::cerr << "Error: " << e.what() << '\n';
+            }
+        }
+
+        // Returns the command with the given name, or nullptr if there is none.
+        auto find(const std::string& _name) -> command*
+        {
+            if (auto iter = commands_.find(_name); iter != std::end(commands_)) {
+                return iter->second.get();
+            }
+
+            try {
+                if (auto cli = find_(_name); cli) {
+                    return commands_.emplace(_name, std::move(cli)).first->second.get();
+                }
+            }
+            catch (const std::exception&) {
+            }
+
+            return nullptr;
+        }
+
+        // Executes a command with the session attached. Exceptions escaping the
+        // command are reported the same way the irods executable does. Commands
+        // may install signal handlers (e.g. cp, rm and repl catch SIGINT to
+        // cancel); the dispositions in effect before the command are restored
+        // afterwards.
+        auto run(command& _cli, const std::vector<std::string>& _args) -> int
+        {
+            static constexpr std::array<int, 3> signals{SIGINT, SIGHUP, SIGTERM};
+            std::array<struct sigaction, signals.size()> dispositions{};
+
+            for (std::size_t i = 0; i < signals.size(); ++i) {
+                ::sigaction(signals[i], nullptr, &dispositions[i]);
+            }
+
+            int ec = 1;
+
+            try {
+                _cli.attach(&session());
+                ec = _cli.execute(_args);
+            }
+            catch (const std::exception& e) {
+                std::cout << "ERROR: " << e.what() << '\n';
+            }
+
+            _cli.attach(nullptr);
+
+            for (std::size_t i = 0; i < signals.size(); ++i) {
+                ::sigaction(signals[i], &dispositions[i], nullptr);
+            }
+
+            // A failed command may have left a connection in an unknown state.
+            if (ec != 0) {
+                session_.reset();
+            }
+
+            return ec;
+        }
+
+    private:
+        auto session() -> transfer_session&
+        {
+            if (!session_) {
+                session_.emplace(env_, max_connections_);
+            }
+
+            return *session_;
+        }
+
+        const rodsEnv env_;
+        const int max_connections_;
+        FindCommand find_;
+        std::optional<transfer_session> session_;
+        std::map<std::string, decltype(std::declval<FindCommand&>()(std::string{}))> commands_;
+    }; // class command_runner
+} // namespace irods::cli
+
+#endif // IRODS_CLI_COMMAND_RUNNER_HPP
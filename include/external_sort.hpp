@@ -0,0 +1,328 @@
+#ifndef IRODS_CLI_EXTERNAL_SORT_HPP
+#define IRODS_CLI_EXTERNAL_SORT_HPP
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace irods::cli
+{
+    // Sorts byte strings in lexicographic order (as compared by memcmp) with a
+    // bounded amount of memory.
+    //
+    // Records are packed into a single arena and sorted in memory until the
+    // memory limit is reached. At that point the buffered records are sorted and
+    // written to a temporary file as a run, and for_each() merges the runs. When
+    // only the first _limit records are wanted, the buffer is pruned to that many
+    // records instead whenever it fills up, so a top-k query only spills to disk
+    // if the k records themselves do not fit into half of the memory limit.
+    //
+    // Callers encode their sort keys so that byte order is the desired order,
+    // e.g. numbers as big-endian integers and strings terminated by a NUL.
+    class external_sorter
+    {
+    public:
+        static constexpr auto unlimited = std::numeric_limits<std::size_t>::max();
+
+        explicit external_sorter(std::size_t _memory_limit, std::size_t _limit = unlimited)
+            : memory_limit_{std::max<std::size_t>(_memory_limit, 1 << 20)}
+            , limit_{_limit}
+        {
+        }
+
+        external_sorter(const external_sorter&) = delete;
+        auto operator=(const external_sorter&) -> external_sorter& = delete;
+
+        auto add(std::string_view _record) -> void
+        {
+            if (_record.size() > std::numeric_limits<std::uint32_t>::max()) {
+                throw std::length_error{"Sort record is too large."};
+            }
+
+            if (limit_ == 0) {
+                return;
+            }
+
+            records_.push_back({arena_.size(), static_cast<std::uint32_t>(_record.size())});
+            arena_.append(_record);
+
+            if (memory_used() >= memory_limit_) {
+                make_room();
+            }
+        }
+
+        // Invokes _func with every record in order, at most _limit times. The
+        // sorter is empty afterwards.
+        template <typename Function>
+        auto for_each(Function _func) -> void
+        {
+            sort_buffer();
+
+            if (runs_.empty()) {
+                const auto count = std::min(records_.size(), limit_);
+
+                for (std::size_t i = 0; i < count; ++i) {
+                    _func(view(records_[i]));
+                }
+
+                clear_buffer();
+
+                return;
+            }
+
+            if (!records_.empty()) {
+                spill();
+            }
+
+            while (runs_.size() > max_fan_in) {
+                auto merged = create_run();
+                const auto first = runs_.end() - static_cast<std::ptrdiff_t>(max_fan_in);
+
+                merge({std::make_move_iterator(first), std::make_move_iterator(runs_.end())},
+                      [&merged](std::string_view _r) { merged.write(_r); });
+                runs_.erase(first, runs_.end());
+                runs_.insert(runs_.begin(), std::move(merged));
+            }
+
+            merge(std::move(runs_), _func);
+            runs_.clear();
+        }
+
+        // The number of runs written to disk so far.
+        auto run_count() const noexcept -> std::size_t
+        {
+            return runs_written_;
+        }
+
+    private:
+        // Runs are merged at most this many at a time, which bounds the number of
+        // open files.
+        static constexpr std::size_t max_fan_in = 64;
+
+        struct record
+        {
+            std::size_t offset;
+            std::uint32_t size;
+        }; // struct record
+
+        // A temporary file of length-prefixed records. The file is unlinked as
+        // soon as it is created, so it disappears with its descriptor.
+        class run
+        {
+        public:
+            explicit run(std::FILE* _file)
+                : file_{_file}
+            {
+            }
+
+            auto write(std::string_view _record) -> void
+            {
+                const auto size = static_cast<std::uint32_t>(_record.size());
+
+                if (std::fwrite(&size, sizeof(size), 1, file_.get()) != 1 ||
+                    std::fwrite(_record.data(), 1, _record.size(), file_.get()) != _record.size())
+                {
+                    throw std::runtime_error{std::string{"Cannot write sort run [error: "} + std::strerror(errno) + "]."};
+                }
+            }
+
+            auto rewind() -> void
+            {
+                if (std::fflush(file_.get()) != 0 || std::fseek(file_.get(), 0, SEEK_SET) != 0) {
+                    throw std::runtime_error{std::string{"Cannot read sort run [error: "} + std::strerror(errno) + "]."};
+                }
+            }
+
+            // Reads the next record into _record. Returns false at the end of the run.
+            auto read(std::string& _record) -> bool
+            {
+                std::uint32_t size;
+
+                if (std::fread(&size, sizeof(size), 1, file_.get()) != 1) {
+                    if (std::ferror(file_.get())) {
+                        throw std::runtime_error{"Cannot read sort run."};
+                    }
+
+                    return false;
+                }
+
+                _record.resize(size);
+
+                if (std::fread(_record.data(), 1, size, file_.get()) != size) {
+                    throw std::runtime_error{"Cannot read sort run."};
+                }
+
+                return true;
+            }
+
+        private:
+            struct closer
+            {
+                auto operator()(std::FILE* _f) const noexcept -> void
+                {
+                    std::fclose(_f);
+                }
+            }; // struct closer
+
+            std::unique_ptr<std::FILE, closer> file_;
+        }; // class run
+
+        auto view(const record& _r) const noexcept -> std::string_view
+        {
+            return {arena_.data() + _r.offset, _r.size};
+        }
+
+        auto memory_used() const noexcept -> std::size_t
+        {
+            return arena_.size() + records_.size() * sizeof(record);
+        }
+
+        auto less() const
+        {
+            return [this](const record& _a, const record& _b) { return view(_a) < view(_b); };
+        }
+
+        auto sort_buffer() -> void
+        {
+            std::sort(records_.begin(), records_.end(), less());
+        }
+
+        auto clear_buffer() -> void
+        {
+            records_.clear();
+            arena_.clear();
+        }
+
+        auto make_room() -> void
+        {
+            if (limit_ < records_.size()) {
+                // Only the smallest _limit records can ever be returned.
+                std::nth_element(records_.begin(), records_.begin() + static_cast<std::ptrdiff_t>(limit_), records_.end(), less());
+                records_.resize(limit_);
+                compact();
+
+                if (memory_used() < memory_limit_ / 2) {
+                    return;
+                }
+            }
+
+            sort_buffer();
+            spill();
+        }
+
+        // Rebuilds the arena from the remaining records.
+        auto compact() -> void
+        {
+            std::string arena;
+            arena.reserve(std::min(arena_.size(), memory_limit_));
+
+            for (auto&& r : records_) {
+                const auto offset = arena.size();
+                arena.append(view(r));
+                r.offset = offset;
+            }
+
+            arena_ = std::move(arena);
+        }
+
+        // Writes the (sorted) buffer to a new run. A run never needs more than
+        // _limit records.
+        auto spill() -> void
+        {
+            auto r = create_run();
+            const auto count = std::min(records_.size(), limit_);
+
+            for (std::size_t i = 0; i < count; ++i) {
+                r.write(view(records_[i]));
+            }
+
+            runs_.push_back(std::move(r));
+            ++runs_written_;
+            clear_buffer();
+        }
+
+        static auto create_run() -> run
+        {
+            const char* tmpdir = std::getenv("TMPDIR");
+            std::string path = tmpdir && *tmpdir ? tmpdir : "/tmp";
+            path += "/irods_cli_sort.XXXXXX";
+
+            const auto fd = ::mkstemp(path.data());
+
+            if (fd < 0) {
+                throw std::runtime_error{"Cannot create temporary file [path: " + path + ", error: " + std::strerror(errno) + "]."};
+            }
+
+            ::unlink(path.c_str());
+
+            auto* file = ::fdopen(fd, "w+b");
+
+            if (!file) {
+                ::close(fd);
+                throw std::runtime_error{"Cannot open temporary file [path: " + path + ", error: " + std::strerror(errno) + "]."};
+            }
+
+            return run{file};
+        }
+
+        // Merges sorted runs, passing at most _limit records to _func.
+        template <typename Function>
+        auto merge(std::vector<run> _runs, Function _func) -> void
+        {
+            struct head
+            {
+                std::string record;
+                std::size_t run;
+            }; // struct head
+
+            const auto greater = [](const head* _a, const head* _b) { return _a->record > _b->record; };
+
+            std::vector<head> heads(_runs.size());
+            std::priority_queue<head*, std::vector<head*>, decltype(greater)> queue{greater};
+
+            for (std::size_t i = 0; i < _runs.size(); ++i) {
+                _runs[i].rewind();
+                heads[i].run = i;
+
+                if (_runs[i].read(heads[i].record)) {
+                    queue.push(&heads[i]);
+                }
+            }
+
+            for (std::size_t emitted = 0; !queue.empty() && emitted < limit_; ++emitted) {
+                auto* h = queue.top();
+                queue.pop();
+
+                _func(std::string_view{h->record});
+
+                if (_runs[h->run].read(h->record)) {
+                    queue.push(h);
+                }
+            }
+        }
+
+        const std::size_t memory_limit_;
+        const std::size_t limit_;
+        std::string arena_;
+        std::vector<record> records_;
+        std::vector<run> runs_;
+        std::size_t runs_written_ = 0;
+    }; // class external_sorter
+} // namespace irods::cli
+
+#endif // IRODS_CLI_EXTERNAL_SORT_HPP
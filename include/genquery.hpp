@@ -0,0 +1,48 @@
+#ifndef IRODS_CLI_GENQUERY_HPP
+#define IRODS_CLI_GENQUERY_HPP
+
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace irods::cli
+{
+    // Returns a value for use between single quotes in a GenQuery condition,
+    // e.g. "where COLL_NAME = '" + genquery_literal(name) + "'".
+    //
+    // The GenQuery1 condition parser ends a literal at the next quote and has
+    // no escape for quotes inside it. Doubling them as in SQL is not known to
+    // work, and this has not been verified against a server. A name containing
+    // a quote would end the literal early and match the wrong rows, so such
+    // names are rejected instead.
+    inline auto genquery_literal(std::string_view _value) -> std::string
+    {
+        if (_value.find('\'') != std::string_view::npos) {
+            throw std::invalid_argument{"Cannot query names containing a single quote [name: " + std::string{_value} + "]."};
+        }
+
+        return std::string{_value};
+    }
+
+    // Returns a value for use in a GenQuery LIKE pattern, e.g. "where COLL_NAME
+    // like '" + escape_genquery_like(name) + "/%'". The wildcards % and _ (and
+    // the escape character itself) are matched literally. Quotes are rejected
+    // as by genquery_literal().
+    inline auto escape_genquery_like(std::string_view _value) -> std::string
+    {
+        std::string escaped;
+        escaped.reserve(_value.size());
+
+        for (auto c : genquery_literal(_value)) {
+            if (c == '\\' || c == '%' || c == '_') {
+                escaped += '\\';
+            }
+
+            escaped += c;
+        }
+
+        return escaped;
+    }
+} // namespace irods::cli
+
+#endif // IRODS_CLI_GENQUERY_HPP
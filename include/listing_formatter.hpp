@@ -0,0 +1,394 @@
+#ifndef IRODS_CLI_LISTING_FORMATTER_HPP
+#define IRODS_CLI_LISTING_FORMATTER_HPP
+
+#include "collection_listing.hpp"
+
+#include <fmt/format.h>
+
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace irods::cli
+{
+    // Formats timestamps as "YYYY-MM-DD HH:MM:SS" in local time. Entries of a
+    // listing tend to share timestamps, or at least dates, so the last result is
+    // reused for the same second, and within the same quarter of an hour only
+    // the minutes and seconds are rewritten. Time zone offsets only change on
+    // quarter-hour boundaries, so the shortcut never crosses a DST transition.
+    class timestamp_cache
+    {
+    public:
+        auto format(std::time_t _time) -> std::string_view
+        {
+            if (_time == last_ && length_ > 0) {
+                return {text_, length_};
+            }
+
+            if (_time >= window_start_ && _time < window_start_ + window_length && length_ > 0) {
+                const auto offset = static_cast<int>(_time - window_start_);
+                write_two_digits(length_ - 5, base_minute_ + offset / 60);
+                write_two_digits(length_ - 2, offset % 60);
+            }
+            else {
+                std::tm tm;
+                localtime_r(&_time, &tm);
+                length_ = std::strftime(text_, sizeof(text_), "%F %T", &tm);
+                base_minute_ = tm.tm_min - tm.tm_min % 15;
+                window_start_ = _time - tm.tm_sec - 60 * (tm.tm_min % 15);
+            }
+
+            last_ = _time;
+
+            return {text_, length_};
+        }
+
+    private:
+        static constexpr std::time_t window_length = 15 * 60;
+
+        auto write_two_digits(std::size_t _pos, int _value) noexcept -> void
+        {
+            text_[_pos] = static_cast<char>('0' + _value / 10);
+            text_[_pos + 1] = static_cast<char>('0' + _value % 10);
+        }
+
+        char text_[64]{};
+        std::size_t length_ = 0;
+        std::time_t last_ = 0;
+        std::time_t window_start_ = 0;
+        int base_minute_ = 0;
+    }; // class timestamp_cache
+
+    // Collects output in a single reusable buffer and writes it to a file
+    // descriptor in large blocks, instead of flushing a stream once per line.
+    class block_writer
+    {
+    public:
+        static constexpr std::size_t block_size = 64 * 1024;
+
+        explicit block_writer(int _fd)
+            : fd_{_fd}
+        {
+        }
+
+        block_writer(const block_writer&) = delete;
+        auto operator=(const block_writer&) -> block_writer& = delete;
+
+        // Output that was never flushed explicitly is written on a best-effort
+        // basis.
+        ~block_writer()
+        {
+            try {
+                flush();
+            }
+            catch (...) {
+            }
+        }
+
+        auto buffer() noexcept -> fmt::memory_buffer&
+        {
+            return buffer_;
+        }
+
+        auto append(std::string_view _data) -> void
+        {
+            buffer_.append(_data.data(), _data.data() + _data.size());
+            flush_if_full();
+        }
+
+        auto flush_if_full() -> void
+        {
+            if (buffer_.size() >= block_size) {
+                flush();
+            }
+        }
+
+        auto flush() -> void
+        {
+            const char* p = buffer_.data();
+            auto remaining = buffer_.size();
+
+            while (remaining > 0) {
+                const auto n = ::write(fd_, p, remaining);
+
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+
+                if (n < 0) {
+                    buffer_.clear();
+                    throw std::runtime_error{std::string{"Cannot write output [error: "} + std::strerror(errno) + "]."};
+                }
+
+                p += n;
+                remaining -= static_cast<std::size_t>(n);
+            }
+
+            buffer_.clear();
+        }
+
+    private:
+        const int fd_;
+        fmt::memory_buffer buffer_;
+    }; // class block_writer
+
+    enum class listing_format
+    {
+        // Columns for humans.
+        text,
+
+        // One JSON object per line, e.g.
+        //
+        //   {"type":"collection","path":"/zone/home/alice/c"}
+        //   {"type":"data_object","collection":"/zone/home/alice","name":"f",
+        //    "replica_number":0,"resource":"demoResc","owner":"alice",
+        //    "size":42,"mtime":1600000000,"good":true}
+        //
+        // With listing_detail::full, data objects also carry "checksum",
+        // "data_type" and "physical_path".
+        jsonl,
+
+        // Length-prefixed binary records. Every record starts with its length
+        // (u32, not counting the length itself) followed by a type byte:
+        //
+        //   1: data object  str collection, str name, u32 replica number,
+        //                   str resource, str owner, u64 size, i64 mtime,
+        //                   u8 good, u8 detail; if detail is 1, also
+        //                   str checksum, str data type, str physical path
+        //   2: collection   str path
+        //
+        // Integers are little-endian; a str is a u32 length followed by that
+        // many bytes.
+        binary
+    };
+
+    // Formats the entries of a long listing (ls -l) and, with
+    // listing_detail::full, of a very long listing (ls -L) in one of the
+    // listing formats. Records are appended to a caller-provided buffer without
+    // temporary strings, so listings can be streamed with constant memory.
+    class listing_formatter
+    {
+    public:
+        explicit listing_formatter(listing_detail _detail, listing_format _format = listing_format::text)
+            : detail_{_detail}
+            , format_{_format}
+        {
+        }
+
+        auto detail() const noexcept -> listing_detail
+        {
+            return detail_;
+        }
+
+        auto format() const noexcept -> listing_format
+        {
+            return format_;
+        }
+
+        auto replica(fmt::memory_buffer& _out, std::string_view _collection, const replica_entry& _e) -> void
+        {
+            switch (format_) {
+                case listing_format::text:
+                    replica_as_text(_out, _e);
+                    break;
+
+                case listing_format::jsonl:
+                    replica_as_json(_out, _collection, _e);
+                    break;
+
+                case listing_format::binary:
+                    replica_as_binary(_out, _collection, _e);
+                    break;
+            }
+        }
+
+        auto collection(fmt::memory_buffer& _out, std::string_view _path) -> void
+        {
+            switch (format_) {
+                case listing_format::text:
+                    fmt::format_to(std::back_inserter(_out), "  C- {}\n", _path);
+                    break;
+
+                case listing_format::jsonl:
+                    append(_out, R"({"type":"collection","path":)");
+                    append_json_string(_out, _path);
+                    append(_out, "}\n");
+                    break;
+
+                case listing_format::binary: {
+                    const auto start = begin_record(_out, record_type::collection);
+                    append_string(_out, _path);
+                    end_record(_out, start);
+                    break;
+                }
+            }
+        }
+
+        // Introduces the entries of a subcollection in recursive listings.
+        // Machine-readable records carry their collection, so only text
+        // listings have headers.
+        auto header(fmt::memory_buffer& _out, std::string_view _path) -> void
+        {
+            if (format_ == listing_format::text) {
+                fmt::format_to(std::back_inserter(_out), "\n{}:\n", _path);
+            }
+        }
+
+    private:
+        enum class record_type : std::uint8_t
+        {
+            data_object = 1,
+            collection = 2
+        };
+
+        auto replica_as_text(fmt::memory_buffer& _out, const replica_entry& _e) -> void
+        {
+            fmt::format_to(std::back_inserter(_out),
+                           "{:<10} {} {:<10} {:>15} {} {} {}\n",
+                           _e.owner,
+                           _e.replica_number,
+                           _e.resource,
+                           _e.size,
+                           timestamps_.format(_e.mtime),
+                           _e.good ? '&' : ' ',
+                           _e.name);
+
+            if (detail_ == listing_detail::full) {
+                fmt::format_to(std::back_inserter(_out),
+                               "    {} {} {}\n",
+                               _e.checksum.empty() ? "-" : _e.checksum,
+                               _e.data_type,
+                               _e.physical_path);
+            }
+        }
+
+        auto replica_as_json(fmt::memory_buffer& _out, std::string_view _collection, const replica_entry& _e) -> void
+        {
+            append(_out, R"({"type":"data_object","collection":)");
+            append_json_string(_out, _collection);
+            append(_out, R"(,"name":)");
+            append_json_string(_out, _e.name);
+            fmt::format_to(std::back_inserter(_out), R"(,"replica_number":{},"resource":)", _e.replica_number);
+            append_json_string(_out, _e.resource);
+            append(_out, R"(,"owner":)");
+            append_json_string(_out, _e.owner);
+            fmt::format_to(std::back_inserter(_out),
+                           R"(,"size":{},"mtime":{},"good":{})",
+                           _e.size,
+                           static_cast<std::int64_t>(_e.mtime),
+                           _e.good);
+
+            if (detail_ == listing_detail::full) {
+                append(_out, R"(,"checksum":)");
+                append_json_string(_out, _e.checksum);
+                append(_out, R"(,"data_type":)");
+                append_json_string(_out, _e.data_type);
+                append(_out, R"(,"physical_path":)");
+                append_json_string(_out, _e.physical_path);
+            }
+
+            append(_out, "}\n");
+        }
+
+        auto replica_as_binary(fmt::memory_buffer& _out, std::string_view _collection, const replica_entry& _e) -> void
+        {
+            const auto start = begin_record(_out, record_type::data_object);
+            append_string(_out, _collection);
+            append_string(_out, _e.name);
+            append_integer<std::uint32_t>(_out, static_cast<std::uint32_t>(_e.replica_number));
+            append_string(_out, _e.resource);
+            append_string(_out, _e.owner);
+            append_integer<std::uint64_t>(_out, _e.size);
+            append_integer<std::uint64_t>(_out, static_cast<std::uint64_t>(static_cast<std::int64_t>(_e.mtime)));
+            append_integer<std::uint8_t>(_out, _e.good ? 1 : 0);
+            append_integer<std::uint8_t>(_out, detail_ == listing_detail::full ? 1 : 0);
+
+            if (detail_ == listing_detail::full) {
+                append_string(_out, _e.checksum);
+                append_string(_out, _e.data_type);
+                append_string(_out, _e.physical_path);
+            }
+
+            end_record(_out, start);
+        }
+
+        static auto append(fmt::memory_buffer& _out, std::string_view _s) -> void
+        {
+            _out.append(_s.data(), _s.data() + _s.size());
+        }
+
+        static auto append_json_string(fmt::memory_buffer& _out, std::string_view _s) -> void
+        {
+            static constexpr char hex[] = "0123456789abcdef";
+
+            _out.push_back('"');
+
+            for (auto c : _s) {
+                switch (c) {
+                    case '"':  append(_out, "\\\""); break;
+                    case '\\': append(_out, "\\\\"); break;
+                    case '\n': append(_out, "\\n"); break;
+                    case '\r': append(_out, "\\r"); break;
+                    case '\t': append(_out, "\\t"); break;
+                    default:
+                        if (static_cast<unsigned char>(c) < 0x20) {
+                            const char escaped[] = {'\\', 'u', '0', '0', hex[(c >> 4) & 0xf], hex[c & 0xf]};
+                            _out.append(escaped, escaped + sizeof(escaped));
+                        }
+                        else {
+                            _out.push_back(c);
+                        }
+                        break;
+                }
+            }
+
+            _out.push_back('"');
+        }
+
+        template <typename T>
+        static auto append_integer(fmt::memory_buffer& _out, T _value) -> void
+        {
+            for (std::size_t i = 0; i < sizeof(T); ++i) {
+                _out.push_back(static_cast<char>((static_cast<std::uint64_t>(_value) >> (8 * i)) & 0xff));
+            }
+        }
+
+        static auto append_string(fmt::memory_buffer& _out, std::string_view _s) -> void
+        {
+            append_integer<std::uint32_t>(_out, static_cast<std::uint32_t>(_s.size()));
+            append(_out, _s);
+        }
+
+        // Reserves room for the length prefix and returns its position.
+        static auto begin_record(fmt::memory_buffer& _out, record_type _type) -> std::size_t
+        {
+            const auto start = _out.size();
+            append_integer<std::uint32_t>(_out, 0);
+            append_integer<std::uint8_t>(_out, static_cast<std::uint8_t>(_type));
+            return start;
+        }
+
+        static auto end_record(fmt::memory_buffer& _out, std::size_t _start) -> void
+        {
+            const auto length = static_cast<std::uint32_t>(_out.size() - _start - sizeof(std::uint32_t));
+
+            for (std::size_t i = 0; i < sizeof(length); ++i) {
+                _out.data()[_start + i] = static_cast<char>((length >> (8 * i)) & 0xff);
+            }
+        }
+
+        const listing_detail detail_;
+        const listing_format format_;
+        timestamp_cache timestamps_;
+    }; // class listing_formatter
+} // namespace irods::cli
+
+#endif // IRODS_CLI_LISTING_FORMATTER_HPP
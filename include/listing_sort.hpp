@@ -0,0 +1,173 @@
+#ifndef IRODS_CLI_LISTING_SORT_HPP
+#define IRODS_CLI_LISTING_SORT_HPP
+
+#include "collection_listing.hpp"
+#include "external_sort.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <string_view>
+
+namespace irods::cli
+{
+    enum class sort_key
+    {
+        // Catalog order.
+        none,
+
+        // Alphabetical.
+        name,
+
+        // Largest first.
+        size,
+
+        // Most recently modified first.
+        time
+    };
+
+    struct sort_options
+    {
+        sort_key key = sort_key::none;
+        bool reverse = false;
+
+        // The maximum number of entries to print.
+        std::size_t head = external_sorter::unlimited;
+
+        // The memory sorting may use before it spills to temporary files.
+        std::size_t memory_limit = 256 * 1024 * 1024;
+    }; // struct sort_options
+
+    // Sorts the replicas of a long listing. Each replica is encoded as a compact
+    // record whose bytes compare in the requested order, so huge collections can
+    // be sorted externally, and --head only ever keeps the first entries.
+    //
+    // A record consists of the sort key, the replica and the length of the
+    // replica, so the replica can be found from the end of the record. Keys are
+    // a big-endian number followed by the name for size and time, or just the
+    // name. Names are terminated by a NUL, which no name contains, so that a
+    // name sorts before its extensions. Descending orders are produced by
+    // inverting every byte of the key.
+    class listing_sorter
+    {
+    public:
+        explicit listing_sorter(const sort_options& _options)
+            : options_{_options}
+            , sorter_{_options.memory_limit, _options.head}
+        {
+        }
+
+        auto add(const replica_entry& _e) -> void
+        {
+            record_.clear();
+
+            const auto descending = (options_.key != sort_key::name) != options_.reverse;
+
+            if (options_.key == sort_key::size) {
+                append_integer(_e.size);
+            }
+            else if (options_.key == sort_key::time) {
+                // Offsetting the signed time keeps the order of times before 1970.
+                append_integer(static_cast<std::uint64_t>(static_cast<std::int64_t>(_e.mtime)) ^ (std::uint64_t{1} << 63));
+            }
+
+            record_ += _e.name;
+            record_ += '\0';
+
+            if (descending) {
+                for (auto& c : record_) {
+                    c = static_cast<char>(~c);
+                }
+            }
+
+            // Replicas of a data object appear in ascending order of their numbers.
+            const auto key_size = record_.size();
+            append_integer(static_cast<std::uint32_t>(_e.replica_number));
+            append_string(_e.resource);
+            append_string(_e.owner);
+            append_integer(_e.size);
+            append_integer(static_cast<std::uint64_t>(_e.mtime));
+            record_ += _e.good ? '\1' : '\0';
+            append_string(_e.name);
+            append_string(_e.checksum);
+            append_string(_e.data_type);
+            append_string(_e.physical_path);
+            append_integer(static_cast<std::uint32_t>(record_.size() - key_size));
+
+            sorter_.add(record_);
+        }
+
+        // Invokes _func(const replica_entry&) with every replica in order, up to
+        // the number of entries requested.
+        template <typename Function>
+        auto for_each(Function _func) -> void
+        {
+            replica_entry e;
+
+            sorter_.for_each([&e, &_func](std::string_view _record) {
+                decode(_record, e);
+                _func(e);
+            });
+        }
+
+    private:
+        template <typename T>
+        auto append_integer(T _value) -> void
+        {
+            for (auto i = sizeof(T); i > 0; --i) {
+                record_ += static_cast<char>((static_cast<std::uint64_t>(_value) >> (8 * (i - 1))) & 0xff);
+            }
+        }
+
+        auto append_string(std::string_view _s) -> void
+        {
+            append_integer(static_cast<std::uint32_t>(_s.size()));
+            record_ += _s;
+        }
+
+        static auto decode(std::string_view _record, replica_entry& _e) -> void
+        {
+            const auto end = _record.size() - sizeof(std::uint32_t);
+            auto pos = end;
+            pos = end - read_integer<std::uint32_t>(_record, pos);
+
+            _e.replica_number = static_cast<int>(read_integer<std::uint32_t>(_record, pos));
+            _e.resource = read_string(_record, pos);
+            _e.owner = read_string(_record, pos);
+            _e.size = read_integer<std::uint64_t>(_record, pos);
+            _e.mtime = static_cast<std::time_t>(read_integer<std::uint64_t>(_record, pos));
+            _e.good = _record[pos++] != '\0';
+            _e.name = read_string(_record, pos);
+            _e.checksum = read_string(_record, pos);
+            _e.data_type = read_string(_record, pos);
+            _e.physical_path = read_string(_record, pos);
+        }
+
+        template <typename T>
+        static auto read_integer(std::string_view _record, std::size_t& _pos) -> T
+        {
+            std::uint64_t value = 0;
+
+            for (std::size_t i = 0; i < sizeof(T); ++i) {
+                value = (value << 8) | static_cast<unsigned char>(_record[_pos++]);
+            }
+
+            return static_cast<T>(value);
+        }
+
+        static auto read_string(std::string_view _record, std::size_t& _pos) -> std::string_view
+        {
+            const auto size = read_integer<std::uint32_t>(_record, _pos);
+            _pos += size;
+
+            return _record.substr(_pos - size, size);
+        }
+
+        const sort_options options_;
+        external_sorter sorter_;
+        std::string record_;
+    }; // class listing_sorter
+} // namespace irods::cli
+
+#endif // IRODS_CLI_LISTING_SORT_HPP
@@ -0,0 +1,342 @@
+#ifndef IRODS_CLI_LOCAL_IO_ENGINE_HPP
+#define IRODS_CLI_LOCAL_IO_ENGINE_HPP
+
+#include "buffer_pool.hpp"
+
+#ifdef IRODS_CLI_HAVE_LIBURING
+    #include <liburing.h>
+#endif
+
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace irods::cli
+{
+    // An owned file descriptor.
+    class file_descriptor
+    {
+    public:
+        file_descriptor(const std::string& _path, int _flags, mode_t _mode = 0644)
+            : fd_{::open(_path.c_str(), _flags | O_CLOEXEC, _mode)}
+        {
+            if (fd_ < 0) {
+                throw std::runtime_error{"Cannot open file [path: " + _path + ", error: " + std::strerror(errno) + "]."};
+            }
+        }
+
+        file_descriptor(const file_descriptor&) = delete;
+        auto operator=(const file_descriptor&) -> file_descriptor& = delete;
+
+        ~file_descriptor()
+        {
+            ::close(fd_);
+        }
+
+        auto get() const noexcept -> int
+        {
+            return fd_;
+        }
+
+    private:
+        const int fd_;
+    }; // class file_descriptor
+
+    // Asynchronous local reads and writes on a fixed set of buffers, one
+    // operation per buffer at a time. Operations are queued, sent to the kernel
+    // in batches by submit(), and collected per buffer by wait(), so a single
+    // thread can keep several reads or writes in flight while it moves other
+    // buffers over the network.
+    //
+    // When built with liburing, the engine drives an io_uring instance with the
+    // buffers registered up front, which spares the kernel from mapping them for
+    // every operation. If io_uring is not available at build or run time (old
+    // kernel, seccomp, locked memory limits), operations are carried out with
+    // pread(2)/pwrite(2) when they are waited for, which behaves like blocking
+    // I/O. Each engine must only be used by one thread.
+    class local_io_engine
+    {
+    public:
+        explicit local_io_engine(const std::vector<buffer_pool::buffer>& _buffers)
+            : ops_(_buffers.size())
+        {
+            for (std::size_t i = 0; i < _buffers.size(); ++i) {
+                ops_[i].data = _buffers[i].data();
+            }
+
+#ifdef IRODS_CLI_HAVE_LIBURING
+            if (::io_uring_queue_init(static_cast<unsigned>(ops_.size()), &ring_, 0) == 0) {
+                uring_ = true;
+
+                std::vector<iovec> iovecs;
+                iovecs.reserve(_buffers.size());
+
+                for (auto&& b : _buffers) {
+                    iovecs.push_back({b.data(), b.size()});
+                }
+
+                registered_ = ::io_uring_register_buffers(&ring_, iovecs.data(), static_cast<unsigned>(iovecs.size())) == 0;
+            }
+#endif
+        }
+
+        local_io_engine(const local_io_engine&) = delete;
+        auto operator=(const local_io_engine&) -> local_io_engine& = delete;
+
+        ~local_io_engine()
+        {
+            drain();
+
+#ifdef IRODS_CLI_HAVE_LIBURING
+            if (uring_) {
+                ::io_uring_queue_exit(&ring_);
+            }
+#endif
+        }
+
+        auto uses_io_uring() const noexcept -> bool
+        {
+            return uring_;
+        }
+
+        auto buffer_count() const noexcept -> std::size_t
+        {
+            return ops_.size();
+        }
+
+        auto buffer(std::size_t _index) const noexcept -> char*
+        {
+            return ops_[_index].data;
+        }
+
+        auto busy(std::size_t _index) const noexcept -> bool
+        {
+            return ops_[_index].state != op_state::idle;
+        }
+
+        // Queues a read of up to _size bytes at _offset into buffer _index.
+        auto queue_read(int _fd, std::size_t _index, std::size_t _size, std::uintmax_t _offset) -> void
+        {
+            queue(op_kind::read, _fd, _index, _size, _offset);
+        }
+
+        // Queues a write of the first _size bytes of buffer _index at _offset.
+        auto queue_write(int _fd, std::size_t _index, std::size_t _size, std::uintmax_t _offset) -> void
+        {
+            queue(op_kind::write, _fd, _index, _size, _offset);
+        }
+
+        // Hands every queued operation to the kernel with a single system call.
+        auto submit() -> void
+        {
+#ifdef IRODS_CLI_HAVE_LIBURING
+            if (uring_ && queued_ > 0) {
+                if (const auto ec = ::io_uring_submit(&ring_); ec < 0) {
+                    throw std::runtime_error{std::string{"Cannot submit local I/O [error: "} + std::strerror(-ec) + "]."};
+                }
+
+                queued_ = 0;
+            }
+#endif
+        }
+
+        // Waits for the operation on buffer _index and returns the number of
+        // bytes transferred. Reads return fewer bytes than requested only at the
+        // end of the file; writes always complete in full. Throws on error.
+        auto wait(std::size_t _index) -> std::size_t
+        {
+            auto& op = ops_[_index];
+
+            if (op.state == op_state::idle) {
+                throw std::logic_error{"No local I/O operation in flight."};
+            }
+
+#ifdef IRODS_CLI_HAVE_LIBURING
+            if (uring_) {
+                submit();
+
+                while (op.state == op_state::in_flight) {
+                    reap();
+                }
+            }
+#endif
+
+            // Also completes short transfers reported by io_uring.
+            if (op.state == op_state::in_flight || (op.state == op_state::done && op.result >= 0)) {
+                finish_synchronously(op);
+            }
+
+            op.state = op_state::idle;
+
+            if (op.result < 0) {
+                throw std::runtime_error{std::string{"Local I/O failed [error: "} + std::strerror(static_cast<int>(-op.result)) + "]."};
+            }
+
+            return static_cast<std::size_t>(op.result);
+        }
+
+        // Waits for every operation in flight and discards the results. Must be
+        // called before the buffers are reused elsewhere, e.g. after an error.
+        auto drain() noexcept -> void
+        {
+            for (auto&& op : ops_) {
+#ifdef IRODS_CLI_HAVE_LIBURING
+                if (uring_) {
+                    if (queued_ > 0) {
+                        ::io_uring_submit(&ring_);
+                        queued_ = 0;
+                    }
+
+                    while (op.state == op_state::in_flight && reap()) {
+                    }
+                }
+#endif
+
+                op.state = op_state::idle;
+            }
+        }
+
+    private:
+        enum class op_kind { read, write };
+        enum class op_state { idle, in_flight, done };
+
+        struct operation
+        {
+            char* data = nullptr;
+            op_kind kind = op_kind::read;
+            op_state state = op_state::idle;
+            int fd = -1;
+            std::size_t size = 0;
+            std::uintmax_t offset = 0;
+            long long result = 0;
+        }; // struct operation
+
+        auto queue(op_kind _kind, int _fd, std::size_t _index, std::size_t _size, std::uintmax_t _offset) -> void
+        {
+            auto& op = ops_[_index];
+
+            if (op.state != op_state::idle) {
+                throw std::logic_error{"Local I/O buffer is busy."};
+            }
+
+            op.kind = _kind;
+            op.fd = _fd;
+            op.size = _size;
+            op.offset = _offset;
+            op.result = 0;
+            op.state = op_state::in_flight;
+
+#ifdef IRODS_CLI_HAVE_LIBURING
+            if (uring_) {
+                auto* sqe = ::io_uring_get_sqe(&ring_);
+
+                // The ring has one entry per buffer, so it cannot be full.
+                if (registered_) {
+                    if (_kind == op_kind::read) {
+                        ::io_uring_prep_read_fixed(sqe, _fd, op.data, static_cast<unsigned>(_size), _offset, static_cast<int>(_index));
+                    }
+                    else {
+                        ::io_uring_prep_write_fixed(sqe, _fd, op.data, static_cast<unsigned>(_size), _offset, static_cast<int>(_index));
+                    }
+                }
+                else if (_kind == op_kind::read) {
+                    ::io_uring_prep_read(sqe, _fd, op.data, static_cast<unsigned>(_size), _offset);
+                }
+                else {
+                    ::io_uring_prep_write(sqe, _fd, op.data, static_cast<unsigned>(_size), _offset);
+                }
+
+                ::io_uring_sqe_set_data(sqe, reinterpret_cast<void*>(static_cast<std::uintptr_t>(_index)));
+                ++queued_;
+            }
+#endif
+        }
+
+#ifdef IRODS_CLI_HAVE_LIBURING
+        // Collects one completion. Returns false if waiting failed.
+        auto reap() noexcept -> bool
+        {
+            io_uring_cqe* cqe = nullptr;
+
+            if (const auto ec = ::io_uring_wait_cqe(&ring_, &cqe); ec < 0) {
+                if (ec == -EINTR) {
+                    return true;
+                }
+
+                // Without completions there is no way to learn the outcome of the
+                // operations in flight; they are failed so nobody waits forever.
+                for (auto&& op : ops_) {
+                    if (op.state == op_state::in_flight) {
+                        op.state = op_state::done;
+                        op.result = ec;
+                    }
+                }
+
+                return false;
+            }
+
+            auto& op = ops_[reinterpret_cast<std::uintptr_t>(::io_uring_cqe_get_data(cqe))];
+            op.result = cqe->res;
+            op.state = op_state::done;
+            ::io_uring_cqe_seen(&ring_, cqe);
+
+            return true;
+        }
+#endif
+
+        // Transfers whatever part of the operation is still outstanding with
+        // pread(2)/pwrite(2).
+        static auto finish_synchronously(operation& _op) noexcept -> void
+        {
+            auto done = static_cast<std::size_t>(_op.state == op_state::done ? _op.result : 0);
+
+            while (done < _op.size) {
+                const auto n = _op.kind == op_kind::read
+                    ? ::pread(_op.fd, _op.data + done, _op.size - done, static_cast<off_t>(_op.offset + done))
+                    : ::pwrite(_op.fd, _op.data + done, _op.size - done, static_cast<off_t>(_op.offset + done));
+
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+
+                if (n < 0) {
+                    _op.result = -errno;
+                    return;
+                }
+
+                if (n == 0) {
+                    if (_op.kind == op_kind::write) {
+                        _op.result = -EIO;
+                        return;
+                    }
+
+                    break;
+                }
+
+                done += static_cast<std::size_t>(n);
+            }
+
+            _op.result = static_cast<long long>(done);
+        }
+
+        std::vector<operation> ops_;
+        bool uring_ = false;
+        bool registered_ = false;
+
+#ifdef IRODS_CLI_HAVE_LIBURING
+        io_uring ring_{};
+        unsigned queued_ = 0;
+#endif
+    }; // class local_io_engine
+} // namespace irods::cli
+
+#endif // IRODS_CLI_LOCAL_IO_ENGINE_HPP
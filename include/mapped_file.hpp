@@ -0,0 +1,199 @@
+#ifndef IRODS_CLI_MAPPED_FILE_HPP
+#define IRODS_CLI_MAPPED_FILE_HPP
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+namespace irods::cli
+{
+    // A memory mapping of a whole local file. Transfer loops hand slices of the
+    // mapping straight to the stream they write to (or read into), instead of
+    // copying the data through an intermediate buffer with read(2)/write(2).
+    // The mapping is advised as sequential, so the kernel reads ahead
+    // aggressively and drops pages behind the cursor. Empty files produce an
+    // empty mapping.
+    class mapped_file
+    {
+    public:
+        // Maps a file for reading, or returns nullptr if the file cannot be
+        // leased (e.g. it is open for writing elsewhere, belongs to another user,
+        // or lives on a file system without leases).
+        //
+        // Reading a page of the mapping past the end of a file that was truncated
+        // in the meantime raises SIGBUS. The read lease makes anyone opening the
+        // file for writing or truncating it wait, and changed() reports that they
+        // are waiting. Readers read the mapping in slices through read_slice(),
+        // which refuses to start once changed() returns true. The lease is given
+        // up as soon as the slices in progress are done, so the writer only
+        // waits for those, not for the rest of the transfer (the kernel would
+        // otherwise make it wait for up to /proc/sys/fs/lease-break-time
+        // seconds).
+        static auto map_leased(const std::string& _path) -> std::unique_ptr<mapped_file>
+        {
+            const auto fd = ::open(_path.c_str(), O_RDONLY | O_CLOEXEC);
+
+            if (fd < 0) {
+                throw std::runtime_error{"Cannot open file for reading [path: " + _path + ", error: " + std::strerror(errno) + "]."};
+            }
+
+            // A lease break is announced with SIGIO, which would terminate the
+            // process. SIGURG is ignored by default; changed() polls instead.
+            if (::fcntl(fd, F_SETSIG, SIGURG) != 0 || ::fcntl(fd, F_SETLEASE, F_RDLCK) != 0) {
+                ::close(fd);
+                return nullptr;
+            }
+
+            return std::unique_ptr<mapped_file>{new mapped_file{_path, fd}};
+        }
+
+        // Maps the first _size bytes of a file opened for writing. The file must
+        // already be at least that large (e.g. preallocated). Stores into the
+        // mapping are written back to the file.
+        mapped_file(const std::string& _path, int _fd, std::uintmax_t _size)
+            : path_{_path}
+        {
+            map(_fd, _size, PROT_READ | PROT_WRITE, MAP_SHARED);
+        }
+
+        mapped_file(const mapped_file&) = delete;
+        auto operator=(const mapped_file&) -> mapped_file& = delete;
+
+        ~mapped_file()
+        {
+            unmap();
+        }
+
+        // Unmaps the file and gives up the lease, e.g. once a transfer has read
+        // everything it needs but the mapping is still shared. Nothing may read
+        // the mapping afterwards.
+        auto unmap() noexcept -> void
+        {
+            if (data_) {
+                ::munmap(data_, size_);
+                data_ = nullptr;
+            }
+
+            // Closing the descriptor releases the lease.
+            if (lease_fd_ >= 0) {
+                ::close(lease_fd_);
+                lease_fd_ = -1;
+            }
+        }
+
+        auto data() const noexcept -> char*
+        {
+            return static_cast<char*>(data_);
+        }
+
+        auto size() const noexcept -> std::size_t
+        {
+            return size_;
+        }
+
+        // Returns true once another process wants to modify a file mapped with
+        // map_leased(), after which the mapping must no longer be read.
+        auto changed() const noexcept -> bool
+        {
+            return lease_fd_ >= 0 && ::fcntl(lease_fd_, F_GETLEASE) != F_RDLCK;
+        }
+
+        // Invokes _func, which reads from the mapping, unless the file is about to
+        // be modified. Returns false if _func was not invoked. Safe to call from
+        // several threads at once.
+        template <typename Function>
+        auto read_slice(Function _func) const -> bool
+        {
+            // Readers announce themselves before checking the lease, so that
+            // the last one to leave after a break sees it and gives up the lease.
+            readers_.fetch_add(1);
+
+            if (changed()) {
+                leave();
+                return false;
+            }
+
+            try {
+                _func();
+            }
+            catch (...) {
+                leave();
+                throw;
+            }
+
+            leave();
+            return true;
+        }
+
+    private:
+        auto leave() const noexcept -> void
+        {
+            if (readers_.fetch_sub(1) == 1 && changed()) {
+                ::fcntl(lease_fd_, F_SETLEASE, F_UNLCK);
+            }
+        }
+
+        // Maps a file opened for reading, taking ownership of the leased
+        // descriptor. The size is taken after the lease, so it cannot change
+        // unnoticed.
+        mapped_file(const std::string& _path, int _lease_fd)
+            : path_{_path}
+            , lease_fd_{_lease_fd}
+        {
+            try {
+                struct stat st;
+
+                if (::fstat(lease_fd_, &st) != 0) {
+                    throw std::runtime_error{"Cannot stat file [path: " + path_ + ", error: " + std::strerror(errno) + "]."};
+                }
+
+                map(lease_fd_, static_cast<std::uintmax_t>(st.st_size), PROT_READ, MAP_PRIVATE);
+            }
+            catch (...) {
+                ::close(lease_fd_);
+                throw;
+            }
+        }
+
+        auto map(int _fd, std::uintmax_t _size, int _protection, int _flags) -> void
+        {
+            if (_size == 0) {
+                return;
+            }
+
+            auto* p = ::mmap(nullptr, static_cast<std::size_t>(_size), _protection, _flags, _fd, 0);
+
+            if (p == MAP_FAILED) {
+                throw std::runtime_error{"Cannot map file [path: " + path_ + ", error: " + std::strerror(errno) + "]."};
+            }
+
+            data_ = p;
+            size_ = static_cast<std::size_t>(_size);
+
+            // Advice is only a hint; a failure does not affect correctness.
+            ::madvise(data_, size_, MADV_SEQUENTIAL);
+        }
+
+        const std::string path_;
+        void* data_ = nullptr;
+        std::size_t size_ = 0;
+        int lease_fd_ = -1;
+
+        // The number of threads reading a slice of the mapping.
+        mutable std::atomic<int> readers_{0};
+    }; // class mapped_file
+} // namespace irods::cli
+
+#endif // IRODS_CLI_MAPPED_FILE_HPP
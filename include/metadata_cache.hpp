@@ -0,0 +1,660 @@
+#ifndef IRODS_CLI_METADATA_CACHE_HPP
+#define IRODS_CLI_METADATA_CACHE_HPP
+
+#include "collection_listing.hpp"
+
+#include <irods/rodsClient.h>
+#include <irods/filesystem.hpp>
+
+#include <boost/filesystem.hpp>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace irods::cli
+{
+    enum class object_kind : std::uint8_t
+    {
+        none,
+        collection,
+        data_object
+    };
+
+    // The result of a long listing of a single collection.
+    struct cached_listing
+    {
+        std::vector<replica_entry> replicas;
+        std::vector<std::string> subcollections;
+    };
+
+    // An opt-in, persistent cache of catalog lookups shared by every command and
+    // process of a user. It is enabled by setting IRODS_CLI_METADATA_CACHE_TTL
+    // to the number of seconds entries stay valid.
+    //
+    // The index is a fixed-size, open-addressing hash table in a file under
+    // ~/.irods/cli_cache that is mapped into memory, so a lookup costs no system
+    // calls. Each slot is guarded by a sequence number: writers (serialized with
+    // flock(2) across processes) make it odd while they update the slot, and
+    // readers discard whatever they copied if the number changed underneath them.
+    // Every slot holds a 128-bit hash of its key instead of the key itself.
+    //
+    // Object kinds are stored in the slots directly. Listings are stored in
+    // separate files next to the index, tagged with a stamp that must match the
+    // one in their slot. Commands that modify the catalog invalidate what they
+    // touched; clear() invalidates everything at once by bumping the epoch the
+    // slots are tagged with. Paths that are not absolute are never cached, since
+    // they depend on the working collection.
+    //
+    // Every invalidation also bumps a generation counter. Callers read it with
+    // generation() before they query the catalog and pass it to the store
+    // functions, which drop the result if anything was invalidated meanwhile,
+    // since it may predate the change.
+    class metadata_cache
+    {
+    public:
+        // Listings with more entries than this are not cached, which keeps
+        // memory use of long listings bounded.
+        static constexpr std::size_t max_listing_entries = 10000;
+
+        // Returns the cache of the current iRODS user, or nullptr if caching is
+        // disabled or the cache cannot be opened. The cache is only an
+        // optimization, so failures are not reported.
+        static auto open(const rodsEnv& _env) -> std::unique_ptr<metadata_cache>
+        {
+            const char* ttl = std::getenv("IRODS_CLI_METADATA_CACHE_TTL");
+            const char* home = std::getenv("HOME");
+            const auto seconds = ttl ? std::atoll(ttl) : 0;
+
+            if (!home || seconds <= 0) {
+                return nullptr;
+            }
+
+            const auto id = std::string{_env.rodsHost} + ':' + std::to_string(_env.rodsPort) + ':' + _env.rodsUserName + '#' + _env.rodsZone;
+            const auto directory = boost::filesystem::path{home} / ".irods" / "cli_cache";
+
+            try {
+                return std::unique_ptr<metadata_cache>{new metadata_cache{directory, to_hex(hash(id).first), seconds}};
+            }
+            catch (const std::exception&) {
+                return nullptr;
+            }
+        }
+
+        metadata_cache(const metadata_cache&) = delete;
+        auto operator=(const metadata_cache&) -> metadata_cache& = delete;
+
+        ~metadata_cache()
+        {
+            ::munmap(header_, mapping_size());
+            ::close(fd_);
+        }
+
+        auto lookup_kind(const std::string& _path) const -> std::optional<object_kind>
+        {
+            if (!is_cacheable(_path)) {
+                return std::nullopt;
+            }
+
+            if (const auto s = read_slot(hash("s:" + normalize(_path))); s) {
+                return static_cast<object_kind>(s->value);
+            }
+
+            return std::nullopt;
+        }
+
+        // Returns the current generation, to be passed to the store functions.
+        auto generation() const noexcept -> std::uint64_t
+        {
+            return header_->generation.load();
+        }
+
+        auto store_kind(const std::string& _path, object_kind _kind, std::uint64_t _generation) -> void
+        {
+            // Only existing objects are cached; creating an object then never
+            // leaves a stale entry behind.
+            if (is_cacheable(_path) && _kind != object_kind::none) {
+                writer_lock lk{*this};
+
+                if (generation() == _generation) {
+                    write_slot(lk, hash("s:" + normalize(_path)), static_cast<std::uint64_t>(_kind));
+                }
+            }
+        }
+
+        auto lookup_listing(const std::string& _collection, listing_detail _detail) const -> std::optional<cached_listing>
+        {
+            if (!is_cacheable(_collection)) {
+                return std::nullopt;
+            }
+
+            const auto key = listing_key(_collection, _detail);
+            const auto s = read_slot(key);
+
+            if (!s) {
+                return std::nullopt;
+            }
+
+            std::ifstream in{listing_path(key), std::ios::binary};
+            std::string data{std::istreambuf_iterator<char>{in}, std::istreambuf_iterator<char>{}};
+
+            return decode_listing(data, s->value);
+        }
+
+        auto store_listing(const std::string& _collection,
+                           listing_detail _detail,
+                           const cached_listing& _listing,
+                           std::uint64_t _generation) -> void
+        {
+            if (!is_cacheable(_collection) || _listing.replicas.size() + _listing.subcollections.size() > max_listing_entries) {
+                return;
+            }
+
+            const auto key = listing_key(_collection, _detail);
+            const auto stamp = header_->next_stamp.fetch_add(1) + 1;
+            const auto path = listing_path(key);
+            const auto temporary = path.string() + ".tmp" + std::to_string(::getpid()) + '.' + std::to_string(stamp);
+
+            {
+                std::ofstream out{temporary, std::ios::binary | std::ios::trunc};
+                const auto data = encode_listing(_listing, stamp);
+
+                if (!out.write(data.data(), static_cast<std::streamsize>(data.size())) || !out.flush()) {
+                    ::unlink(temporary.c_str());
+                    return;
+                }
+            }
+
+            writer_lock lk{*this};
+
+            if (generation() != _generation || ::rename(temporary.c_str(), path.c_str()) != 0) {
+                ::unlink(temporary.c_str());
+                return;
+            }
+
+            write_slot(lk, key, stamp);
+        }
+
+        // Forgets the kind and listings of a path, and the listings of its
+        // parent collection.
+        auto invalidate(const std::string& _path) -> void
+        {
+            if (!is_cacheable(_path)) {
+                return;
+            }
+
+            const auto path = normalize(_path);
+            const auto parent = path.substr(0, std::max<std::size_t>(path.rfind('/'), 1));
+
+            header_->generation.fetch_add(1);
+            erase_slot(hash("s:" + path));
+
+            for (auto detail : {listing_detail::basic, listing_detail::full}) {
+                erase_listing(listing_key(path, detail));
+                erase_listing(listing_key(parent, detail));
+            }
+        }
+
+        // Forgets everything, e.g. after a collection has been removed.
+        auto clear() -> void
+        {
+            header_->generation.fetch_add(1);
+            header_->epoch.fetch_add(1);
+
+            boost::system::error_code ec;
+
+            for (boost::filesystem::directory_iterator i{directory_, ec}, end; !ec && i != end; i.increment(ec)) {
+                if (i->path().filename().string().compare(0, prefix_.size(), prefix_) == 0) {
+                    boost::filesystem::remove(i->path(), ec);
+                }
+            }
+        }
+
+    private:
+        using key_type = std::pair<std::uint64_t, std::uint64_t>;
+
+        static constexpr char file_magic[8] = {'I', 'C', 'L', 'I', 'M', 'C', '0', '2'};
+        static constexpr std::size_t slot_count = 1 << 16;
+        static constexpr std::size_t probe_limit = 16;
+
+        struct header
+        {
+            char magic[8];
+            std::atomic<std::uint64_t> epoch;
+            std::atomic<std::uint64_t> next_stamp;
+            std::atomic<std::uint64_t> generation;
+        }; // struct header
+
+        // Every field is a lock-free atomic, so slots can be shared between
+        // processes through the mapping.
+        struct slot
+        {
+            std::atomic<std::uint64_t> sequence;
+            std::atomic<std::uint64_t> key_high;
+            std::atomic<std::uint64_t> key_low;
+            std::atomic<std::uint64_t> epoch;
+            std::atomic<std::int64_t> expires;
+            std::atomic<std::uint64_t> value;
+        }; // struct slot
+
+        struct slot_contents
+        {
+            std::uint64_t value;
+        }; // struct slot_contents
+
+        static_assert(std::atomic<std::uint64_t>::is_always_lock_free);
+
+        // Serializes writers: threads with the mutex, processes with flock(2).
+        class writer_lock
+        {
+        public:
+            explicit writer_lock(metadata_cache& _cache)
+                : cache_{_cache}
+                , lk_{_cache.mtx_}
+            {
+                while (::flock(cache_.fd_, LOCK_EX) != 0 && errno == EINTR) {
+                }
+            }
+
+            writer_lock(const writer_lock&) = delete;
+            auto operator=(const writer_lock&) -> writer_lock& = delete;
+
+            ~writer_lock()
+            {
+                ::flock(cache_.fd_, LOCK_UN);
+            }
+
+        private:
+            metadata_cache& cache_;
+            std::lock_guard<std::mutex> lk_;
+        }; // class writer_lock
+
+        metadata_cache(const boost::filesystem::path& _directory, const std::string& _id, long long _ttl)
+            : directory_{_directory}
+            , prefix_{_id + '-'}
+            , ttl_{static_cast<std::time_t>(_ttl)}
+        {
+            boost::filesystem::create_directories(directory_);
+            ::chmod(directory_.c_str(), 0700);
+
+            const auto path = directory_ / (_id + ".index");
+            fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+
+            if (fd_ < 0) {
+                throw std::runtime_error{"Cannot open metadata cache [path: " + path.string() + "]."};
+            }
+
+            {
+                writer_lock lk{*this};
+
+                // A new, truncated or foreign file is (re)initialized. Zeroed slots
+                // are empty.
+                struct stat st;
+                char existing[sizeof(file_magic)]{};
+
+                if (::fstat(fd_, &st) != 0 ||
+                    static_cast<std::size_t>(st.st_size) != mapping_size() ||
+                    ::pread(fd_, existing, sizeof(existing), 0) != static_cast<ssize_t>(sizeof(existing)) ||
+                    std::memcmp(existing, file_magic, sizeof(file_magic)) != 0)
+                {
+                    if (::ftruncate(fd_, 0) != 0 ||
+                        ::ftruncate(fd_, static_cast<off_t>(mapping_size())) != 0 ||
+                        ::pwrite(fd_, file_magic, sizeof(file_magic), 0) != static_cast<ssize_t>(sizeof(file_magic)))
+                    {
+                        ::close(fd_);
+                        throw std::runtime_error{"Cannot initialize metadata cache [path: " + path.string() + "]."};
+                    }
+                }
+            }
+
+            auto* p = ::mmap(nullptr, mapping_size(), PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+
+            if (p == MAP_FAILED) {
+                ::close(fd_);
+                throw std::runtime_error{"Cannot map metadata cache [path: " + path.string() + "]."};
+            }
+
+            header_ = static_cast<header*>(p);
+            slots_ = reinterpret_cast<slot*>(static_cast<char*>(p) + slots_offset());
+        }
+
+        static constexpr auto slots_offset() noexcept -> std::size_t
+        {
+            return 64;
+        }
+
+        static constexpr auto mapping_size() noexcept -> std::size_t
+        {
+            static_assert(sizeof(header) <= slots_offset());
+            return slots_offset() + slot_count * sizeof(slot);
+        }
+
+        static auto is_cacheable(const std::string& _path) noexcept -> bool
+        {
+            return !_path.empty() && _path.front() == '/';
+        }
+
+        // Two FNV-1a hashes with different offset bases.
+        static auto hash(std::string_view _key) noexcept -> key_type
+        {
+            std::uint64_t high = 14695981039346656037ull;
+            std::uint64_t low = 0x9e3779b97f4a7c15ull;
+
+            for (auto c : _key) {
+                high = (high ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+                low = (low ^ static_cast<unsigned char>(c)) * 0x100000001b3ull;
+                low ^= low >> 29;
+            }
+
+            // Zero marks an empty slot.
+            return {high, low | 1};
+        }
+
+        // Strips trailing slashes, so "/zone/home/" and "/zone/home" share entries.
+        static auto normalize(std::string _path) -> std::string
+        {
+            while (_path.size() > 1 && _path.back() == '/') {
+                _path.pop_back();
+            }
+
+            return _path;
+        }
+
+        static auto to_hex(std::uint64_t _value) -> std::string
+        {
+            static constexpr char digits[] = "0123456789abcdef";
+            std::string hex(16, '0');
+
+            for (auto i = hex.rbegin(); i != hex.rend(); ++i, _value >>= 4) {
+                *i = digits[_value & 0xf];
+            }
+
+            return hex;
+        }
+
+        static auto listing_key(const std::string& _collection, listing_detail _detail) -> key_type
+        {
+            return hash((_detail == listing_detail::full ? "L:" : "l:") + normalize(_collection));
+        }
+
+        auto listing_path(const key_type& _key) const -> boost::filesystem::path
+        {
+            return directory_ / (prefix_ + to_hex(_key.first) + to_hex(_key.second) + ".listing");
+        }
+
+        static auto now() noexcept -> std::time_t
+        {
+            return std::time(nullptr);
+        }
+
+        auto read_slot(const key_type& _key) const -> std::optional<slot_contents>
+        {
+            const auto base = static_cast<std::size_t>(_key.first % slot_count);
+            const auto epoch = header_->epoch.load(std::memory_order_relaxed);
+
+            for (std::size_t i = 0; i < probe_limit; ++i) {
+                auto& s = slots_[(base + i) % slot_count];
+
+                const auto before = s.sequence.load(std::memory_order_acquire);
+                const auto high = s.key_high.load(std::memory_order_relaxed);
+                const auto low = s.key_low.load(std::memory_order_relaxed);
+                const auto slot_epoch = s.epoch.load(std::memory_order_relaxed);
+                const auto expires = s.expires.load(std::memory_order_relaxed);
+                const auto value = s.value.load(std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_acquire);
+
+                if (before % 2 != 0 || s.sequence.load(std::memory_order_relaxed) != before) {
+                    continue;
+                }
+
+                if (high == _key.first && low == _key.second) {
+                    if (slot_epoch != epoch || expires <= now()) {
+                        return std::nullopt;
+                    }
+
+                    return slot_contents{value};
+                }
+            }
+
+            return std::nullopt;
+        }
+
+        // Stores a value in the slot of a key. A listing whose slot is taken over
+        // by another key can no longer be found, so its file is removed.
+        auto write_slot(const writer_lock&, const key_type& _key, std::uint64_t _value) -> void
+        {
+            const auto epoch = header_->epoch.load();
+            const auto t = now();
+
+            const auto replaceable = [epoch, t](const slot& _s) {
+                return _s.key_low.load() == 0 || _s.epoch.load() != epoch || _s.expires.load() <= t;
+            };
+
+            // Prefers the slot of the same key, then one that is unused or no longer
+            // valid, then the one that expires first.
+            slot* target = nullptr;
+
+            for (std::size_t i = 0; i < probe_limit; ++i) {
+                auto& s = slots_[(_key.first + i) % slot_count];
+
+                if (s.key_high.load() == _key.first && s.key_low.load() == _key.second) {
+                    target = &s;
+                    break;
+                }
+
+                if (!target ||
+                    (replaceable(s) && !replaceable(*target)) ||
+                    (replaceable(s) == replaceable(*target) && s.expires.load() < target->expires.load()))
+                {
+                    target = &s;
+                }
+            }
+
+            const key_type evicted{target->key_high.load(), target->key_low.load()};
+
+            if (evicted.second != 0 && evicted != _key) {
+                ::unlink(listing_path(evicted).c_str());
+            }
+
+            target->sequence.fetch_add(1, std::memory_order_acq_rel);
+            target->key_high.store(_key.first, std::memory_order_relaxed);
+            target->key_low.store(_key.second, std::memory_order_relaxed);
+            target->epoch.store(epoch, std::memory_order_relaxed);
+            target->expires.store(t + ttl_, std::memory_order_relaxed);
+            target->value.store(_value, std::memory_order_relaxed);
+            target->sequence.fetch_add(1, std::memory_order_release);
+        }
+
+        auto erase_slot(const key_type& _key) -> void
+        {
+            writer_lock lk{*this};
+
+            for (std::size_t i = 0; i < probe_limit; ++i) {
+                auto& s = slots_[(_key.first + i) % slot_count];
+
+                if (s.key_high.load() == _key.first && s.key_low.load() == _key.second) {
+                    // Expiring the slot keeps the probe sequence of other keys intact.
+                    s.sequence.fetch_add(1, std::memory_order_acq_rel);
+                    s.expires.store(0, std::memory_order_relaxed);
+                    s.sequence.fetch_add(1, std::memory_order_release);
+                    return;
+                }
+            }
+        }
+
+        auto erase_listing(const key_type& _key) -> void
+        {
+            erase_slot(_key);
+            ::unlink(listing_path(_key).c_str());
+        }
+
+        // Listing files consist of the stamp, the number of replicas and
+        // subcollections, and the entries, with integers in native byte order and
+        // strings prefixed by their length.
+        static auto encode_listing(const cached_listing& _listing, std::uint64_t _stamp) -> std::string
+        {
+            std::string data;
+
+            const auto put_integer = [&data](std::uint64_t _value) {
+                data.append(reinterpret_cast<const char*>(&_value), sizeof(_value));
+            };
+
+            const auto put_string = [&](const std::string& _s) {
+                put_integer(_s.size());
+                data += _s;
+            };
+
+            put_integer(_stamp);
+            put_integer(_listing.replicas.size());
+            put_integer(_listing.subcollections.size());
+
+            for (auto&& e : _listing.replicas) {
+                put_string(e.name);
+                put_integer(static_cast<std::uint64_t>(e.replica_number));
+                put_string(e.resource);
+                put_string(e.owner);
+                put_integer(e.size);
+                put_integer(static_cast<std::uint64_t>(e.mtime));
+                put_integer(e.good ? 1 : 0);
+                put_string(e.checksum);
+                put_string(e.data_type);
+                put_string(e.physical_path);
+            }
+
+            for (auto&& c : _listing.subcollections) {
+                put_string(c);
+            }
+
+            return data;
+        }
+
+        static auto decode_listing(const std::string& _data, std::uint64_t _stamp) -> std::optional<cached_listing>
+        {
+            std::size_t pos = 0;
+            bool ok = true;
+
+            const auto get_integer = [&]() -> std::uint64_t {
+                std::uint64_t value = 0;
+
+                if (_data.size() - pos < sizeof(value)) {
+                    ok = false;
+                    return 0;
+                }
+
+                std::memcpy(&value, _data.data() + pos, sizeof(value));
+                pos += sizeof(value);
+
+                return value;
+            };
+
+            const auto get_string = [&]() -> std::string {
+                const auto size = get_integer();
+
+                if (!ok || _data.size() - pos < size) {
+                    ok = false;
+                    return {};
+                }
+
+                pos += size;
+
+                return _data.substr(pos - size, size);
+            };
+
+            // A file replaced after the slot was read carries a different stamp.
+            if (get_integer() != _stamp || !ok) {
+                return std::nullopt;
+            }
+
+            const auto replica_count = get_integer();
+            const auto subcollection_count = get_integer();
+
+            if (!ok || replica_count + subcollection_count > max_listing_entries) {
+                return std::nullopt;
+            }
+
+            cached_listing listing;
+            listing.replicas.resize(replica_count);
+            listing.subcollections.reserve(subcollection_count);
+
+            for (auto&& e : listing.replicas) {
+                e.name = get_string();
+                e.replica_number = static_cast<int>(get_integer());
+                e.resource = get_string();
+                e.owner = get_string();
+                e.size = get_integer();
+                e.mtime = static_cast<std::time_t>(get_integer());
+                e.good = get_integer() != 0;
+                e.checksum = get_string();
+                e.data_type = get_string();
+                e.physical_path = get_string();
+            }
+
+            for (std::uint64_t i = 0; i < subcollection_count; ++i) {
+                listing.subcollections.push_back(get_string());
+            }
+
+            if (!ok) {
+                return std::nullopt;
+            }
+
+            return listing;
+        }
+
+        const boost::filesystem::path directory_;
+        const std::string prefix_;
+        const std::time_t ttl_;
+        int fd_ = -1;
+        header* header_ = nullptr;
+        slot* slots_ = nullptr;
+        std::mutex mtx_;
+    }; // class metadata_cache
+
+    // Returns the kind of object a logical path points to, consulting the cache
+    // first if there is one.
+    inline auto object_kind_of(metadata_cache* _cache, rcComm_t& _comm, const std::string& _path) -> object_kind
+    {
+        if (_cache) {
+            if (const auto kind = _cache->lookup_kind(_path); kind) {
+                return *kind;
+            }
+        }
+
+        const auto generation = _cache ? _cache->generation() : 0;
+
+        namespace ifs = irods::experimental::filesystem;
+
+        const auto s = ifs::client::status(_comm, _path);
+        const auto kind = ifs::client::is_collection(s)    ? object_kind::collection
+                        : ifs::client::is_data_object(s) ? object_kind::data_object
+                                                         : object_kind::none;
+
+        if (_cache) {
+            _cache->store_kind(_path, kind, generation);
+        }
+
+        return kind;
+    }
+} // namespace irods::cli
+
+#endif // IRODS_CLI_METADATA_CACHE_HPP
@@ -0,0 +1,285 @@
+#ifndef IRODS_CLI_TAR_ARCHIVE_HPP
+#define IRODS_CLI_TAR_ARCHIVE_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+// Minimal streaming support for the POSIX ustar format. Archives are written
+// and read strictly sequentially so that they can be produced and consumed
+// directly over a data object stream without a temporary file. Names that do
+// not fit into the ustar name and prefix fields are stored using GNU long name
+// records, which the iRODS server (through libarchive) understands.
+namespace irods::cli::tar
+{
+    constexpr std::size_t block_size = 512;
+
+    enum class entry_type : char
+    {
+        regular_file = '0',
+        directory = '5',
+        gnu_long_name = 'L'
+    };
+
+    struct entry
+    {
+        std::string name;
+        std::uintmax_t size;
+        std::time_t mtime;
+        unsigned mode;
+        char type;
+    };
+
+    namespace detail
+    {
+        using block_type = std::array<char, block_size>;
+
+        // clang-format off
+        constexpr std::size_t name_offset     = 0;
+        constexpr std::size_t mode_offset     = 100;
+        constexpr std::size_t uid_offset      = 108;
+        constexpr std::size_t gid_offset      = 116;
+        constexpr std::size_t size_offset     = 124;
+        constexpr std::size_t mtime_offset    = 136;
+        constexpr std::size_t checksum_offset = 148;
+        constexpr std::size_t type_offset     = 156;
+        constexpr std::size_t magic_offset    = 257;
+        constexpr std::size_t version_offset  = 263;
+        constexpr std::size_t prefix_offset   = 345;
+
+        constexpr std::size_t name_length     = 100;
+        constexpr std::size_t prefix_length   = 155;
+        // clang-format on
+
+        // GNU long names are paths, so anything much longer than PATH_MAX comes
+        // from a corrupt or hostile archive and is not worth allocating for.
+        constexpr std::uintmax_t max_long_name_length = 8192;
+
+        inline auto write_octal(char* _field, std::size_t _length, std::uintmax_t _value) -> void
+        {
+            // Octal numbers are NUL terminated. Values that do not fit are stored
+            // in the base-256 form understood by GNU tar and libarchive.
+            if (_length < 2 || _value >= (std::uintmax_t{1} << (3 * (_length - 1)))) {
+                std::memset(_field, 0, _length);
+
+                for (auto i = _length - 1; i > 0; --i, _value >>= 8) {
+                    _field[i] = static_cast<char>(_value & 0xff);
+                }
+
+                _field[0] = static_cast<char>(0x80);
+                return;
+            }
+
+            _field[_length - 1] = '\0';
+
+            for (auto i = _length - 1; i > 0; --i, _value >>= 3) {
+                _field[i - 1] = static_cast<char>('0' + (_value & 7));
+            }
+        }
+
+        inline auto read_number(const char* _field, std::size_t _length) -> std::uintmax_t
+        {
+            std::uintmax_t value = 0;
+
+            if (static_cast<unsigned char>(_field[0]) & 0x80) {
+                value = static_cast<unsigned char>(_field[0]) & 0x7f;
+
+                for (std::size_t i = 1; i < _length; ++i) {
+                    value = (value << 8) | static_cast<unsigned char>(_field[i]);
+                }
+
+                return value;
+            }
+
+            for (std::size_t i = 0; i < _length && _field[i]; ++i) {
+                if (_field[i] >= '0' && _field[i] <= '7') {
+                    value = (value << 3) | static_cast<std::uintmax_t>(_field[i] - '0');
+                }
+            }
+
+            return value;
+        }
+
+        inline auto compute_checksum(const block_type& _block) -> unsigned
+        {
+            unsigned sum = 0;
+
+            for (std::size_t i = 0; i < _block.size(); ++i) {
+                const auto in_checksum_field = i >= checksum_offset && i < checksum_offset + 8;
+                sum += in_checksum_field ? ' ' : static_cast<unsigned char>(_block[i]);
+            }
+
+            return sum;
+        }
+
+        inline auto read_string(const char* _field, std::size_t _length) -> std::string
+        {
+            return {_field, static_cast<std::size_t>(std::find(_field, _field + _length, '\0') - _field)};
+        }
+
+        inline auto write_block(std::ostream& _out,
+                                std::string_view _name,
+                                std::string_view _prefix,
+                                std::uintmax_t _size,
+                                std::time_t _mtime,
+                                unsigned _mode,
+                                char _type) -> void
+        {
+            block_type block{};
+
+            _name.copy(&block[name_offset], name_length);
+            _prefix.copy(&block[prefix_offset], prefix_length);
+            write_octal(&block[mode_offset], 8, _mode);
+            write_octal(&block[uid_offset], 8, 0);
+            write_octal(&block[gid_offset], 8, 0);
+            write_octal(&block[size_offset], 12, _size);
+            write_octal(&block[mtime_offset], 12, static_cast<std::uintmax_t>(std::max<std::time_t>(_mtime, 0)));
+            block[type_offset] = _type;
+            std::memcpy(&block[magic_offset], "ustar", 6);
+            std::memcpy(&block[version_offset], "00", 2);
+
+            write_octal(&block[checksum_offset], 7, compute_checksum(block));
+            block[checksum_offset + 7] = ' ';
+
+            _out.write(block.data(), block.size());
+        }
+    } // namespace detail
+
+    // Returns the number of bytes an entry of the given size occupies in the
+    // archive once padded to a whole number of blocks.
+    constexpr auto padded_size(std::uintmax_t _size) noexcept -> std::uintmax_t
+    {
+        return (_size + block_size - 1) / block_size * block_size;
+    }
+
+    inline auto write_padding(std::ostream& _out, std::uintmax_t _size) -> void
+    {
+        static constexpr detail::block_type zeros{};
+
+        if (const auto n = padded_size(_size) - _size; n > 0) {
+            _out.write(zeros.data(), static_cast<std::streamsize>(n));
+        }
+    }
+
+    // Writes the header (or headers) for an entry. The caller is expected to
+    // write exactly _size bytes of content followed by write_padding().
+    inline auto write_header(std::ostream& _out,
+                             std::string _name,
+                             std::uintmax_t _size,
+                             std::time_t _mtime,
+                             unsigned _mode,
+                             entry_type _type) -> void
+    {
+        if (_type == entry_type::directory && (_name.empty() || _name.back() != '/')) {
+            _name += '/';
+        }
+
+        const auto type = static_cast<char>(_type);
+
+        if (_name.size() <= detail::name_length) {
+            detail::write_block(_out, _name, {}, _size, _mtime, _mode, type);
+            return;
+        }
+
+        // Try to split the name at a slash so that it fits into the prefix and
+        // name fields of a single ustar header.
+        const auto split = _name.rfind('/', detail::prefix_length);
+
+        if (split != std::string::npos && split > 0 && _name.size() - split - 1 <= detail::name_length &&
+            _name.size() - split - 1 > 0)
+        {
+            const std::string_view name{_name};
+            detail::write_block(_out, name.substr(split + 1), name.substr(0, split), _size, _mtime, _mode, type);
+            return;
+        }
+
+        detail::write_block(_out,
+                            "././@LongLink",
+                            {},
+                            _name.size() + 1,
+                            0,
+                            0,
+                            static_cast<char>(entry_type::gnu_long_name));
+        _out.write(_name.c_str(), _name.size() + 1);
+        write_padding(_out, _name.size() + 1);
+        detail::write_block(_out, std::string_view{_name}.substr(0, detail::name_length), {}, _size, _mtime, _mode, type);
+    }
+
+    inline auto write_end_of_archive(std::ostream& _out) -> void
+    {
+        static constexpr detail::block_type zeros{};
+        _out.write(zeros.data(), zeros.size());
+        _out.write(zeros.data(), zeros.size());
+    }
+
+    // Invokes _func for every entry in the archive. The content of each entry is
+    // skipped with a relative seek, so only the headers are transferred when the
+    // stream is backed by a data object.
+    template <typename Function>
+    auto for_each_entry(std::istream& _in, Function _func) -> void
+    {
+        detail::block_type block;
+        std::string long_name;
+
+        while (_in.read(block.data(), block.size())) {
+            if (std::all_of(block.begin(), block.end(), [](char c) { return c == '\0'; })) {
+                return;
+            }
+
+            const auto checksum = detail::read_number(&block[detail::checksum_offset], 8);
+
+            if (checksum != detail::compute_checksum(block)) {
+                throw std::runtime_error{"Invalid tar header checksum."};
+            }
+
+            entry e;
+            e.size = detail::read_number(&block[detail::size_offset], 12);
+            e.mtime = static_cast<std::time_t>(detail::read_number(&block[detail::mtime_offset], 12));
+            e.mode = static_cast<unsigned>(detail::read_number(&block[detail::mode_offset], 8));
+            e.type = block[detail::type_offset];
+
+            if (e.type == static_cast<char>(entry_type::gnu_long_name)) {
+                if (e.size > detail::max_long_name_length) {
+                    throw std::runtime_error{"Invalid tar long name [size: " + std::to_string(e.size) + "]."};
+                }
+
+                long_name.resize(padded_size(e.size));
+
+                if (!_in.read(long_name.data(), static_cast<std::streamsize>(long_name.size()))) {
+                    throw std::runtime_error{"Truncated tar archive."};
+                }
+
+                long_name.resize(std::strlen(long_name.c_str()));
+                continue;
+            }
+
+            if (!long_name.empty()) {
+                e.name = std::move(long_name);
+                long_name.clear();
+            }
+            else {
+                const auto prefix = detail::read_string(&block[detail::prefix_offset], detail::prefix_length);
+                const auto name = detail::read_string(&block[detail::name_offset], detail::name_length);
+                e.name = prefix.empty() ? name : prefix + '/' + name;
+            }
+
+            // Extended headers carry no user visible entry.
+            if (e.type != 'x' && e.type != 'g') {
+                _func(e);
+            }
+
+            if (const auto n = padded_size(e.size); n > 0 && !_in.seekg(static_cast<std::streamoff>(n), std::ios_base::cur)) {
+                throw std::runtime_error{"Truncated tar archive."};
+            }
+        }
+    }
+} // namespace irods::cli::tar
+
+#endif // IRODS_CLI_TAR_ARCHIVE_HPP
@@ -0,0 +1,224 @@
+#ifndef IRODS_CLI_TRANSFER_JOURNAL_HPP
+#define IRODS_CLI_TRANSFER_JOURNAL_HPP
+
+#include "chunk_scheduler.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <boost/filesystem.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace irods::cli
+{
+    // An append-only restart journal. Each completed byte range and each
+    // completed file is recorded as one line, written with a single write(2) on
+    // a descriptor opened with O_APPEND, so concurrent workers never interleave
+    // records and an interrupted run leaves at most one truncated line behind.
+    //
+    // Records have the form:
+    //
+    //   R <offset> <size> <key length> <key>
+    //   F <key length> <key>
+    //
+    // Keys identify a source (e.g. its path, size and mtime). When a journal is
+    // opened for resuming, previously recorded entries are loaded and can be
+    // queried; otherwise the journal starts out empty.
+    class transfer_journal
+    {
+    public:
+        transfer_journal(const boost::filesystem::path& _path, bool _resume)
+            : path_{_path}
+        {
+            if (_resume) {
+                load();
+            }
+
+            boost::filesystem::create_directories(path_.parent_path());
+
+            const auto flags = O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC | (_resume ? 0 : O_TRUNC);
+            fd_ = ::open(path_.c_str(), flags, 0600);
+
+            if (fd_ < 0) {
+                throw std::runtime_error{"Cannot open journal [path: " + path_.generic_string() + ", error: " + std::strerror(errno) + "]."};
+            }
+        }
+
+        transfer_journal(const transfer_journal&) = delete;
+        auto operator=(const transfer_journal&) -> transfer_journal& = delete;
+
+        ~transfer_journal()
+        {
+            if (fd_ >= 0) {
+                ::close(fd_);
+            }
+        }
+
+        // Returns a stable journal location under ~/.irods for the given kind of
+        // transfer and source/destination pair.
+        static auto default_path(std::string_view _kind, std::string_view _key) -> boost::filesystem::path
+        {
+            // FNV-1a, so that the same transfer maps to the same file across builds.
+            std::uint64_t hash = 14695981039346656037ull;
+
+            for (auto c : _key) {
+                hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+            }
+
+            const char* home = std::getenv("HOME");
+            boost::filesystem::path p = home ? home : ".";
+            p /= ".irods";
+            p /= "cli_" + std::string{_kind} + "_" + std::to_string(hash) + ".journal";
+
+            return p;
+        }
+
+        auto path() const noexcept -> const boost::filesystem::path&
+        {
+            return path_;
+        }
+
+        auto is_file_complete(const std::string& _key) const -> bool
+        {
+            return files_.count(_key) > 0;
+        }
+
+        // Returns true if any range of the source has been recorded, meaning a
+        // previous run already created (and partially wrote) the destination.
+        auto has_ranges(const std::string& _key) const -> bool
+        {
+            return ranges_.count(_key) > 0;
+        }
+
+        auto is_range_complete(const std::string& _key, const byte_range& _range) const -> bool
+        {
+            if (auto iter = ranges_.find(_key); iter != std::end(ranges_)) {
+                auto r = iter->second.find(_range.offset);
+                return r != std::end(iter->second) && r->second >= _range.size;
+            }
+
+            return false;
+        }
+
+        // Returns the number of bytes, starting at offset zero, covered by
+        // contiguous completed ranges.
+        auto completed_prefix(const std::string& _key) const -> std::uintmax_t
+        {
+            std::uintmax_t end = 0;
+
+            if (auto iter = ranges_.find(_key); iter != std::end(ranges_)) {
+                for (auto&& [offset, size] : iter->second) {
+                    if (offset > end) {
+                        break;
+                    }
+
+                    end = std::max(end, offset + size);
+                }
+            }
+
+            return end;
+        }
+
+        auto mark_range_complete(const std::string& _key, const byte_range& _range) -> void
+        {
+            append("R " + std::to_string(_range.offset) + ' ' + std::to_string(_range.size) + ' ' + encode(_key));
+        }
+
+        auto mark_file_complete(const std::string& _key) -> void
+        {
+            append("F " + encode(_key));
+        }
+
+        // Removes the journal file. Called once a transfer has fully succeeded.
+        auto remove() -> void
+        {
+            boost::system::error_code ec;
+            boost::filesystem::remove(path_, ec);
+        }
+
+    private:
+        static auto encode(const std::string& _key) -> std::string
+        {
+            return std::to_string(_key.size()) + ' ' + _key + '\n';
+        }
+
+        auto append(const std::string& _record) -> void
+        {
+            if (::write(fd_, _record.data(), _record.size()) != static_cast<ssize_t>(_record.size())) {
+                throw std::runtime_error{"Cannot write to journal [path: " + path_.generic_string() + "]."};
+            }
+        }
+
+        auto load() -> void
+        {
+            std::ifstream in{path_.c_str(), std::ios_base::binary};
+
+            if (!in) {
+                return;
+            }
+
+            std::streamoff valid_end = 0;
+            char type;
+
+            // A truncated final record fails to parse and ends the loop, which is
+            // exactly what should happen to a record that was never completed.
+            while (in >> type) {
+                std::uintmax_t offset = 0;
+                std::uintmax_t size = 0;
+
+                if (type == 'R' && !(in >> offset >> size)) {
+                    break;
+                }
+
+                std::size_t length = 0;
+
+                if (!(in >> length) || in.get() != ' ') {
+                    break;
+                }
+
+                std::string key(length, '\0');
+
+                if (!in.read(key.data(), length) || in.get() != '\n') {
+                    break;
+                }
+
+                if (type == 'R') {
+                    auto& size_ref = ranges_[key][offset];
+                    size_ref = std::max(size_ref, size);
+                }
+                else if (type == 'F') {
+                    files_.insert(std::move(key));
+                }
+
+                valid_end = in.tellg();
+            }
+
+            // Drop the partial record, if any, so that new records are appended
+            // after the last complete one.
+            in.close();
+
+            if (boost::filesystem::file_size(path_) > static_cast<std::uintmax_t>(valid_end)) {
+                boost::filesystem::resize_file(path_, static_cast<std::uintmax_t>(valid_end));
+            }
+        }
+
+        const boost::filesystem::path path_;
+        int fd_ = -1;
+        std::unordered_set<std::string> files_;
+        std::unordered_map<std::string, std::map<std::uintmax_t, std::uintmax_t>> ranges_;
+    }; // class transfer_journal
+} // namespace irods::cli
+
+#endif // IRODS_CLI_TRANSFER_JOURNAL_HPP
@@ -0,0 +1,171 @@
+#ifndef IRODS_CLI_TRANSFER_PIPELINE_HPP
+#define IRODS_CLI_TRANSFER_PIPELINE_HPP
+
+#include "buffer_pool.hpp"
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace irods::cli
+{
+    // Moves a stream of bytes from a reader stage to a writer stage through a
+    // ring of buffers, so that reading the next block overlaps with writing the
+    // previous one.
+    //
+    // _read is called as _read(char* data, std::size_t capacity) and returns the
+    // number of bytes placed in the buffer. It must only return fewer bytes than
+    // the capacity at the end of the input (as std::istream::read does).
+    // _write is called as _write(const char* data, std::size_t size) in input
+    // order. Both stages report errors by throwing; the first error stops the
+    // pipeline and is rethrown to the caller.
+    //
+    // Inputs that fit into a single buffer are handled entirely on the calling
+    // thread, so small files do not pay for starting a reader thread.
+    //
+    // The last _hold buffers written are kept from the reader, e.g. because
+    // _write spliced them into a pipe that may still reference them. At least
+    // _hold + 1 buffers are waited for. Buffers still held when the pipeline
+    // returns go back to the pool; the caller makes sure nothing references
+    // them by then.
+    template <typename Reader, typename Writer>
+    auto run_pipeline(buffer_pool& _buffers, std::size_t _depth, Reader _read, Writer _write, std::size_t _hold = 0) -> void
+    {
+        struct block
+        {
+            buffer_pool::buffer buffer;
+            std::size_t size;
+        };
+
+        // With a single buffer the stages simply alternate.
+        auto ring = _buffers.acquire_batch(_depth);
+
+        while (ring.size() <= _hold) {
+            ring.push_back(_buffers.acquire());
+        }
+
+        const auto capacity = _buffers.buffer_size();
+
+        const auto first = _read(ring.front().data(), capacity);
+        _write(ring.front().data(), first);
+
+        if (first < capacity) {
+            return;
+        }
+
+        std::mutex mtx;
+        std::condition_variable cv;
+        std::deque<buffer_pool::buffer> empty{std::make_move_iterator(ring.begin()), std::make_move_iterator(ring.end())};
+        std::deque<buffer_pool::buffer> held;
+        std::deque<block> full;
+        bool done = false;
+        bool cancelled = false;
+        std::exception_ptr reader_error;
+
+        if (_hold > 0) {
+            held.push_back(std::move(empty.front()));
+            empty.pop_front();
+        }
+
+        std::thread reader{[&] {
+            try {
+                while (true) {
+                    buffer_pool::buffer b;
+
+                    {
+                        std::unique_lock lk{mtx};
+                        cv.wait(lk, [&] { return cancelled || !empty.empty(); });
+
+                        if (cancelled) {
+                            return;
+                        }
+
+                        b = std::move(empty.front());
+                        empty.pop_front();
+                    }
+
+                    const auto n = _read(b.data(), capacity);
+
+                    {
+                        std::lock_guard lk{mtx};
+
+                        if (n > 0) {
+                            full.push_back({std::move(b), n});
+                        }
+
+                        done = n < capacity;
+                    }
+
+                    cv.notify_all();
+
+                    if (n < capacity) {
+                        return;
+                    }
+                }
+            }
+            catch (...) {
+                {
+                    std::lock_guard lk{mtx};
+                    reader_error = std::current_exception();
+                    done = true;
+                }
+
+                cv.notify_all();
+            }
+        }};
+
+        try {
+            while (true) {
+                block blk;
+
+                {
+                    std::unique_lock lk{mtx};
+                    cv.wait(lk, [&] { return done || !full.empty(); });
+
+                    if (full.empty()) {
+                        break;
+                    }
+
+                    blk = std::move(full.front());
+                    full.pop_front();
+                }
+
+                _write(blk.buffer.data(), blk.size);
+                held.push_back(std::move(blk.buffer));
+
+                if (held.size() > _hold) {
+                    {
+                        std::lock_guard lk{mtx};
+                        empty.push_back(std::move(held.front()));
+                    }
+
+                    held.pop_front();
+                    cv.notify_all();
+                }
+            }
+        }
+        catch (...) {
+            {
+                std::lock_guard lk{mtx};
+                cancelled = true;
+            }
+
+            cv.notify_all();
+            reader.join();
+            throw;
+        }
+
+        reader.join();
+
+        if (reader_error) {
+            std::rethrow_exception(reader_error);
+        }
+    }
+} // namespace irods::cli
+
+#endif // IRODS_CLI_TRANSFER_PIPELINE_HPP
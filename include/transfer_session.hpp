@@ -0,0 +1,353 @@
+#ifndef IRODS_CLI_TRANSFER_SESSION_HPP
+#define IRODS_CLI_TRANSFER_SESSION_HPP
+
+#include <irods/rodsClient.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <iterator>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace irods::cli
+{
+    // Owns every connection used by a command. Connections are opened on demand,
+    // up to a fixed maximum, and handed back to the session when released so
+    // that the next task reuses an already authenticated connection instead of
+    // paying for another handshake.
+    //
+    // Callers that know they will need several connections call warm_up(),
+    // which opens them concurrently in the background. Nobody waits for all of
+    // them: acquire() returns the first connection that becomes ready, so a
+    // transfer starts after a single handshake and scales up as the others
+    // arrive, no matter how many connections were asked for.
+    //
+    // A connection whose protocol state is unknown, because a stream or an API
+    // call on it failed, must not be reused. Such connections are poisoned:
+    // explicitly with poison(), or implicitly when they are released by an
+    // exception unwinding the stack. Poisoned connections are closed instead
+    // of being handed back, which frees their slot for a new connection.
+    class transfer_session
+    {
+    public:
+        class connection
+        {
+        public:
+            connection() noexcept = default;
+
+            connection(connection&& _other) noexcept
+                : session_{std::exchange(_other.session_, nullptr)}
+                , comm_{std::exchange(_other.comm_, nullptr)}
+                , poisoned_{std::exchange(_other.poisoned_, false)}
+                , uncaught_exceptions_{_other.uncaught_exceptions_}
+            {
+            }
+
+            auto operator=(connection&& _other) noexcept -> connection&
+            {
+                if (this != &_other) {
+                    release();
+                    session_ = std::exchange(_other.session_, nullptr);
+                    comm_ = std::exchange(_other.comm_, nullptr);
+                    poisoned_ = std::exchange(_other.poisoned_, false);
+                    uncaught_exceptions_ = _other.uncaught_exceptions_;
+                }
+
+                return *this;
+            }
+
+            ~connection()
+            {
+                release();
+            }
+
+            explicit operator bool() const noexcept
+            {
+                return comm_ != nullptr;
+            }
+
+            operator rcComm_t&() const noexcept
+            {
+                return *comm_;
+            }
+
+            auto get() const noexcept -> rcComm_t*
+            {
+                return comm_;
+            }
+
+            // Marks the connection as unusable once released, e.g. after a stream
+            // on it failed.
+            auto poison() noexcept -> void
+            {
+                poisoned_ = true;
+            }
+
+            auto release() noexcept -> void
+            {
+                if (session_ && comm_) {
+                    const auto unwinding = std::uncaught_exceptions() > uncaught_exceptions_;
+                    session_->give_back(comm_, !poisoned_ && !unwinding);
+                }
+
+                session_ = nullptr;
+                comm_ = nullptr;
+                poisoned_ = false;
+            }
+
+        private:
+            friend class transfer_session;
+
+            connection(transfer_session* _session, rcComm_t* _comm) noexcept
+                : session_{_session}
+                , comm_{_comm}
+                , uncaught_exceptions_{std::uncaught_exceptions()}
+            {
+            }
+
+            transfer_session* session_ = nullptr;
+            rcComm_t* comm_ = nullptr;
+            bool poisoned_ = false;
+
+            // The number of exceptions in flight when the connection was taken.
+            // More of them on release means that an exception is unwinding past
+            // the connection.
+            int uncaught_exceptions_ = 0;
+        }; // class connection
+
+        transfer_session(const rodsEnv& _env, int _max_connections)
+            : host_{_env.rodsHost}
+            , port_{_env.rodsPort}
+            , username_{_env.rodsUserName}
+            , zone_{_env.rodsZone}
+            , max_connections_{std::max(_max_connections, 1)}
+        {
+        }
+
+        transfer_session(const transfer_session&) = delete;
+        auto operator=(const transfer_session&) -> transfer_session& = delete;
+
+        ~transfer_session()
+        {
+            for (auto&& t : connectors_) {
+                t.join();
+            }
+
+            for (auto* comm : idle_) {
+                rcDisconnect(comm);
+            }
+        }
+
+        // Returns an idle connection, opens a new one if the maximum has not been
+        // reached, or waits for another task to release its connection. While
+        // warm_up() is still opening connections, those are waited for instead
+        // of opening yet another one.
+        auto acquire() -> connection
+        {
+            std::unique_lock lk{mtx_};
+            cv_.wait(lk, [this] { return !idle_.empty() || (open_connections_ < max_connections_ && connecting_ == 0); });
+            return take(lk);
+        }
+
+        // Like acquire(), but returns an empty connection instead of waiting for
+        // another task to release one. Used by helper tasks that are only worth
+        // running if a connection is available. Connections still being opened
+        // by warm_up() are waited for, as they do not depend on other tasks.
+        auto try_acquire() -> connection
+        {
+            std::unique_lock lk{mtx_};
+            cv_.wait(lk, [this] { return !idle_.empty() || connecting_ == 0; });
+
+            if (idle_.empty() && open_connections_ >= max_connections_) {
+                return {};
+            }
+
+            return take(lk);
+        }
+
+        // Starts opening connections in the background until _count of them
+        // (at most the maximum) are open or being opened. Returns immediately.
+        // Connections that cannot be opened are left to acquire(), which reports
+        // the error.
+        auto warm_up(int _count) -> void
+        {
+            std::vector<std::thread> finished;
+
+            {
+                std::lock_guard lk{mtx_};
+                const auto target = std::min(_count, max_connections_);
+
+                // Threads of earlier warm-ups that are done are joined here, so
+                // that a long-lived session does not accumulate them.
+                const auto done = std::stable_partition(std::begin(connectors_), std::end(connectors_), [this](const std::thread& _t) {
+                    return std::find(std::begin(finished_), std::end(finished_), _t.get_id()) == std::end(finished_);
+                });
+
+                std::move(done, std::end(connectors_), std::back_inserter(finished));
+                connectors_.erase(done, std::end(connectors_));
+                finished_.clear();
+
+                while (open_connections_ < target) {
+                    connectors_.emplace_back([this] { connect_in_background(); });
+                    ++open_connections_;
+                    ++connecting_;
+                }
+
+                idle_.reserve(open_connections_);
+            }
+
+            for (auto&& t : finished) {
+                t.join();
+            }
+        }
+
+        auto max_connections() const noexcept -> int
+        {
+            return max_connections_;
+        }
+
+        auto connections_opened() const noexcept -> int
+        {
+            return connections_opened_.load();
+        }
+
+        auto connections_reused() const noexcept -> int
+        {
+            return connections_reused_.load();
+        }
+
+    private:
+        auto take(std::unique_lock<std::mutex>& _lk) -> connection
+        {
+            if (!idle_.empty()) {
+                auto* comm = idle_.back();
+                idle_.pop_back();
+
+                // Connections opened in the background are new to their first user.
+                if (unused_ > 0) {
+                    --unused_;
+                }
+                else {
+                    ++connections_reused_;
+                }
+
+                return {this, comm};
+            }
+
+            // Reserve the slot before connecting so that concurrent callers never
+            // open more than the maximum number of connections.
+            idle_.reserve(++open_connections_);
+            _lk.unlock();
+
+            try {
+                auto* comm = connect();
+                ++connections_opened_;
+                return {this, comm};
+            }
+            catch (...) {
+                {
+                    std::lock_guard lk{mtx_};
+                    --open_connections_;
+                }
+
+                cv_.notify_one();
+                throw;
+            }
+        }
+
+        auto connect() -> rcComm_t*
+        {
+            rErrMsg_t error{};
+            auto* comm = rcConnect(host_.c_str(), port_, username_.c_str(), zone_.c_str(), NO_RECONN, &error);
+
+            if (!comm) {
+                throw std::runtime_error{"Cannot connect to server [host: " + host_ + "]."};
+            }
+
+            if (clientLogin(comm) != 0) {
+                rcDisconnect(comm);
+                throw std::runtime_error{"Cannot authenticate with server [host: " + host_ + "]."};
+            }
+
+            return comm;
+        }
+
+        auto connect_in_background() noexcept -> void
+        {
+            rcComm_t* comm = nullptr;
+
+            try {
+                comm = connect();
+                ++connections_opened_;
+            }
+            catch (...) {
+            }
+
+            {
+                std::lock_guard lk{mtx_};
+                --connecting_;
+                finished_.push_back(std::this_thread::get_id());
+
+                if (comm) {
+                    idle_.push_back(comm);
+                    ++unused_;
+                }
+                else {
+                    --open_connections_;
+                }
+            }
+
+            // Wakes acquire() for the new connection or the free slot, and
+            // try_acquire() for the end of the warm-up.
+            cv_.notify_all();
+        }
+
+        auto give_back(rcComm_t* _comm, bool _reusable) noexcept -> void
+        {
+            if (!_reusable) {
+                rcDisconnect(_comm);
+            }
+
+            {
+                std::lock_guard lk{mtx_};
+
+                if (_reusable) {
+                    idle_.push_back(_comm);
+                }
+                else {
+                    --open_connections_;
+                }
+            }
+
+            cv_.notify_one();
+        }
+
+        const std::string host_;
+        const int port_;
+        const std::string username_;
+        const std::string zone_;
+        const int max_connections_;
+        int open_connections_ = 0;
+        int connecting_ = 0;
+        int unused_ = 0;
+        std::vector<rcComm_t*> idle_;
+        std::vector<std::thread> connectors_;
+
+        // The connectors that are done and can be joined without waiting for a
+        // handshake.
+        std::vector<std::thread::id> finished_;
+
+        std::mutex mtx_;
+        std::condition_variable cv_;
+        std::atomic<int> connections_opened_{0};
+        std::atomic<int> connections_reused_{0};
+    }; // class transfer_session
+} // namespace irods::cli
+
+#endif // IRODS_CLI_TRANSFER_SESSION_HPP
@@ -0,0 +1,392 @@
+#ifndef IRODS_CLI_TREE_WALKER_HPP
+#define IRODS_CLI_TREE_WALKER_HPP
+
+#include "transfer_session.hpp"
+
+#include <irods/rodsClient.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace irods::cli
+{
+    enum class walk_order
+    {
+        // Output is delivered in the order of a sequential depth-first walk.
+        ordered,
+
+        // Output is delivered as soon as each collection has been visited.
+        unordered
+    };
+
+    // Walks a collection tree with one worker per connection of a session.
+    //
+    // Every collection is visited exactly once by calling
+    //
+    //   _visit(rcComm_t& comm, const std::string& collection, std::string& output)
+    //
+    // which appends whatever it wants to report to output and returns the
+    // subcollections to descend into, in the order their output should appear.
+    // Each worker keeps the subcollections it discovers in its own queue and
+    // continues depth first from there; idle workers steal the oldest, and
+    // therefore usually largest, pending subtrees from the other queues, so a
+    // wide tree is spread over all connections while a narrow one costs no
+    // coordination.
+    //
+    // The output of every collection is passed to _sink(const std::string&),
+    // one call at a time. In ordered mode, output that arrives early is held
+    // until everything before it has been delivered, and _sink runs on the
+    // calling thread. Once the held output reaches the buffer limit, workers
+    // only visit the collection whose output is due next, so they cannot run
+    // arbitrarily far ahead of a slow sink. In unordered mode, every collection
+    // is freed as soon as it has been visited.
+    //
+    // The first exception thrown by _visit or _sink stops the walk and is
+    // rethrown to the caller.
+    class tree_walker
+    {
+    public:
+        explicit tree_walker(transfer_session& _session, std::size_t _max_buffered_bytes = 64 * 1024 * 1024)
+            : session_{_session}
+            , max_buffered_bytes_{_max_buffered_bytes}
+        {
+        }
+
+        template <typename Visit, typename Sink>
+        auto walk(const std::string& _root, walk_order _order, Visit _visit, Sink _sink) -> void
+        {
+            const auto worker_count = static_cast<std::size_t>(session_.max_connections());
+
+            auto root = std::make_unique<node>();
+            root->collection = _root;
+
+            queues_ = std::vector<work_queue>(worker_count);
+            queues_[0].nodes.push_back(root.get());
+            order_ = _order;
+            queued_ = 1;
+            pending_ = 1;
+            buffered_bytes_ = 0;
+            wanted_ = nullptr;
+            stopped_ = false;
+            error_ = nullptr;
+
+            // In unordered mode, a node belongs to the queue it is in and then to
+            // the worker that takes it.
+            if (_order == walk_order::unordered) {
+                root.release();
+            }
+
+            // Listing the root only takes one connection; the others are opened
+            // meanwhile, ready for its subcollections.
+            session_.warm_up(static_cast<int>(worker_count));
+
+            std::vector<std::thread> workers;
+            workers.reserve(worker_count);
+
+            for (std::size_t i = 0; i < worker_count; ++i) {
+                workers.emplace_back([this, i, _order, &_visit, &_sink] {
+                    try {
+                        run_worker(i, _order, _visit, _sink);
+                    }
+                    catch (...) {
+                        stop(std::current_exception());
+                    }
+                });
+            }
+
+            // Nodes still on the stack when the walk stops may be in use by a
+            // worker, so they are only released once every worker has finished.
+            std::vector<std::unique_ptr<node>> stack;
+
+            if (_order == walk_order::ordered) {
+                try {
+                    stack.push_back(std::move(root));
+                    emit_in_order(stack, _sink);
+                }
+                catch (...) {
+                    stop(std::current_exception());
+                }
+            }
+
+            for (auto&& t : workers) {
+                t.join();
+            }
+
+            // A stopped walk may leave nodes in the queues.
+            if (_order == walk_order::unordered) {
+                for (auto&& q : queues_) {
+                    for (auto* n : q.nodes) {
+                        delete n;
+                    }
+                }
+            }
+
+            if (error_) {
+                std::rethrow_exception(error_);
+            }
+        }
+
+    private:
+        struct node
+        {
+            std::string collection;
+            std::string output;
+            std::vector<std::unique_ptr<node>> children;
+            bool visited = false;
+        }; // struct node
+
+        struct work_queue
+        {
+            std::deque<node*> nodes;
+            std::mutex mtx;
+        }; // struct work_queue
+
+        template <typename Visit, typename Sink>
+        auto run_worker(std::size_t _index, walk_order _order, Visit& _visit, Sink& _sink) -> void
+        {
+            transfer_session::connection conn;
+
+            while (auto* n = next(_index)) {
+                // Nobody else refers to an unordered node once it is taken.
+                std::unique_ptr<node> owned{_order == walk_order::unordered ? n : nullptr};
+
+                if (!conn) {
+                    conn = session_.acquire();
+                }
+
+                std::string output;
+                auto subcollections = _visit(static_cast<rcComm_t&>(conn), n->collection, output);
+
+                std::vector<std::unique_ptr<node>> children;
+                children.reserve(subcollections.size());
+
+                for (auto&& c : subcollections) {
+                    children.push_back(std::make_unique<node>());
+                    children.back()->collection = std::move(c);
+                }
+
+                // Children are pushed in reverse so that the owner pops them from
+                // the back in listing order. Thieves take from the front, where the
+                // oldest entries are.
+                {
+                    std::lock_guard lk{mtx_};
+                    pending_ += children.size();
+                    queued_ += children.size();
+                }
+
+                {
+                    auto& q = queues_[_index];
+                    std::lock_guard lk{q.mtx};
+                    std::transform(children.rbegin(), children.rend(), std::back_inserter(q.nodes), [_order](auto& c) {
+                        return _order == walk_order::unordered ? c.release() : c.get();
+                    });
+                }
+
+                if (_order == walk_order::unordered) {
+                    std::lock_guard lk{sink_mtx_};
+
+                    if (!output.empty()) {
+                        _sink(output);
+                    }
+                }
+                else {
+                    std::lock_guard lk{mtx_};
+                    buffered_bytes_ += output.size();
+                    n->output = std::move(output);
+                    n->children = std::move(children);
+                    n->visited = true;
+                }
+
+                {
+                    std::lock_guard lk{mtx_};
+                    --pending_;
+                }
+
+                cv_.notify_all();
+            }
+        }
+
+        // Returns the next collection for the given worker, or nullptr once the
+        // walk is complete or has been stopped. A slot is reserved before the
+        // queues are searched, which guarantees that the search succeeds.
+        //
+        // While the buffer limit is reached, workers wait until the emitter
+        // names the node it is waiting for, and one of them takes that node. It
+        // may already have been taken by another worker, in which case the slot
+        // is given back.
+        auto next(std::size_t _index) -> node*
+        {
+            while (true) {
+                node* wanted = nullptr;
+
+                {
+                    std::unique_lock lk{mtx_};
+                    cv_.wait(lk, [this] { return stopped_ || pending_ == 0 || (queued_ > 0 && (!buffer_full() || wanted_)); });
+
+                    if (stopped_ || queued_ == 0) {
+                        return nullptr;
+                    }
+
+                    --queued_;
+
+                    if (buffer_full()) {
+                        wanted = std::exchange(wanted_, nullptr);
+                    }
+                }
+
+                if (!wanted) {
+                    return take_any(_index);
+                }
+
+                if (take(wanted)) {
+                    return wanted;
+                }
+
+                {
+                    std::lock_guard lk{mtx_};
+                    ++queued_;
+                }
+
+                cv_.notify_all();
+            }
+        }
+
+        // Whether held output has reached the limit. Must be called with mtx_
+        // held.
+        auto buffer_full() const noexcept -> bool
+        {
+            return order_ == walk_order::ordered && buffered_bytes_ >= max_buffered_bytes_;
+        }
+
+        // Removes a specific node from whichever queue holds it.
+        auto take(node* _node) -> bool
+        {
+            for (auto&& q : queues_) {
+                std::lock_guard lk{q.mtx};
+
+                if (auto iter = std::find(std::begin(q.nodes), std::end(q.nodes), _node); iter != std::end(q.nodes)) {
+                    q.nodes.erase(iter);
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        // Takes a node from the worker's own queue, or steals one from another.
+        auto take_any(std::size_t _index) -> node*
+        {
+            while (true) {
+                {
+                    auto& q = queues_[_index];
+                    std::lock_guard lk{q.mtx};
+
+                    if (!q.nodes.empty()) {
+                        auto* n = q.nodes.back();
+                        q.nodes.pop_back();
+                        return n;
+                    }
+                }
+
+                for (std::size_t i = 1; i < queues_.size(); ++i) {
+                    auto& q = queues_[(_index + i) % queues_.size()];
+                    std::lock_guard lk{q.mtx};
+
+                    if (!q.nodes.empty()) {
+                        auto* n = q.nodes.front();
+                        q.nodes.pop_front();
+                        return n;
+                    }
+                }
+
+                std::this_thread::yield();
+            }
+        }
+
+        template <typename Sink>
+        auto emit_in_order(std::vector<std::unique_ptr<node>>& _stack, Sink& _sink) -> void
+        {
+            while (!_stack.empty()) {
+                {
+                    std::unique_lock lk{mtx_};
+                    auto* wanted = _stack.back().get();
+
+                    if (!wanted->visited) {
+                        wanted_ = wanted;
+                        cv_.notify_all();
+                    }
+
+                    cv_.wait(lk, [this, wanted] { return stopped_ || wanted->visited; });
+
+                    if (stopped_) {
+                        return;
+                    }
+
+                    if (wanted_ == wanted) {
+                        wanted_ = nullptr;
+                    }
+
+                    buffered_bytes_ -= wanted->output.size();
+                }
+
+                cv_.notify_all();
+
+                // A visited node is no longer referenced by any worker.
+                auto n = std::move(_stack.back());
+                _stack.pop_back();
+
+                if (!n->output.empty()) {
+                    _sink(n->output);
+                }
+
+                std::move(n->children.rbegin(), n->children.rend(), std::back_inserter(_stack));
+            }
+        }
+
+        auto stop(std::exception_ptr _error) noexcept -> void
+        {
+            {
+                std::lock_guard lk{mtx_};
+
+                if (!error_) {
+                    error_ = _error;
+                }
+
+                stopped_ = true;
+            }
+
+            cv_.notify_all();
+        }
+
+        transfer_session& session_;
+        const std::size_t max_buffered_bytes_;
+        std::vector<work_queue> queues_;
+        walk_order order_ = walk_order::ordered;
+        std::size_t queued_ = 0;
+        std::size_t pending_ = 0;
+
+        // The size of the output of visited nodes not yet emitted (ordered mode).
+        std::size_t buffered_bytes_ = 0;
+
+        // The node the emitter is waiting for, until a worker sets out to take it.
+        node* wanted_ = nullptr;
+
+        bool stopped_ = false;
+        std::exception_ptr error_;
+        std::mutex mtx_;
+        std::mutex sink_mtx_;
+        std::condition_variable cv_;
+    }; // class tree_walker
+} // namespace irods::cli
+
+#endif // IRODS_CLI_TREE_WALKER_HPP
@@ -1,30 +1,75 @@
 #include "command.hpp"
+#include "agent.hpp"
+#include "batch.hpp"
 
 #include <irods/rodsClient.h>
 #include <irods/irods_default_paths.hpp>
 
 #include <boost/program_options.hpp>
 #include <boost/filesystem.hpp>
-#include <boost/dll.hpp>
+#include <boost/shared_ptr.hpp>
+
+#ifdef IRODS_CLI_STATIC_COMMANDS
+    #include "static_commands.hpp" // Generated by CMakeLists.txt
+#else
+    #include <boost/dll.hpp>
+#endif
 
 #include <fmt/format.h>
 
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <map>
+#include <optional>
+#include <sstream>
 #include <stdexcept>
 #include <string>
-#include <unordered_map>
+#include <vector>
 
 namespace po = boost::program_options;
 namespace fs = boost::filesystem;
 
-using cli_command_map_type = std::unordered_map<std::string_view, boost::shared_ptr<irods::cli::command>>;
+#ifndef IRODS_CLI_STATIC_COMMANDS
+// What is known about a CLI command plugin without loading it.
+struct cli_plugin_info
+{
+    std::string description;
+    fs::path library;
+    std::string library_version;
+};
+
+// Maps command names to plugins. The manifest of a plugin directory is cached
+// under ~/.irods and only rebuilt when the directory or a library changes, so
+// running a command loads nothing but the plugin implementing it. Without
+// HOME, nothing is cached and every run loads all plugins.
+using cli_plugin_manifest = std::map<std::string, cli_plugin_info>;
 
 auto is_shared_library(const fs::path& p) -> bool;
 
-auto load_cli_command_plugins(const po::variables_map& vm) -> cli_command_map_type;
+auto get_cli_plugin_directory(const po::variables_map& vm) -> fs::path;
+auto file_version(const fs::path& p) -> std::string;
+auto manifest_cache_path(const fs::path& lib_dir) -> std::optional<fs::path>;
+auto load_cli_plugin_manifest(const fs::path& lib_dir, bool rebuild) -> cli_plugin_manifest;
+auto load_cli_command_plugin(const cli_plugin_info& plugin) -> boost::shared_ptr<irods::cli::command>;
+#endif // IRODS_CLI_STATIC_COMMANDS
+
+// Returns the command with the given name, or nullptr if there is none.
+auto find_cli_command(const po::variables_map& vm, const std::string& name) -> boost::shared_ptr<irods::cli::command>;
+
+// Runs the agent (irods agent), which serves commands over a Unix domain socket.
+auto run_agent(const po::variables_map& vm, const std::vector<std::string>& args) -> int;
+
+// Runs the commands of a file or stdin in this process (irods batch).
+auto run_batch(const po::variables_map& vm, const std::vector<std::string>& args) -> int;
 
 auto print_version_info() noexcept -> void;
-auto print_usage_info(const cli_command_map_type& cli) -> void;
+auto print_usage_info(const po::variables_map& vm) -> void;
 
 int main(int argc, char* argv[])
 {
@@ -56,30 +101,47 @@ int main(int argc, char* argv[])
             return 0;
         }
 
-        load_client_api_plugins();
-
-        auto cli = load_cli_command_plugins(vm);
-
         if (const auto show_help_text = vm.count("help") > 0; vm.count("command")) {
             const auto command = vm["command"].as<std::string>();
-            auto iter = cli.find(command);
+            auto remaining_args = po::collect_unrecognized(parsed.options, po::include_positional);
+
+            if (command == "agent" || command == "batch") {
+                if (show_help_text) {
+                    print_usage_info(vm);
+                    return 0;
+                }
+
+                remaining_args.erase(std::begin(remaining_args));
+                return command == "agent" ? run_agent(vm, remaining_args) : run_batch(vm, remaining_args);
+            }
+
+            // A running agent executes the command with warm connections, which
+            // also saves loading the plugin here.
+            if (rodsEnv env; !show_help_text && getRodsEnv(&env) >= 0) {
+                if (const auto ec = irods::cli::agent::execute(env, remaining_args); ec) {
+                    return *ec;
+                }
+            }
+
+            auto cli = find_cli_command(vm, command);
 
-            if (auto iter = cli.find(command); std::end(cli) == iter) {
+            if (!cli) {
                 fmt::print("Invalid command: {}\n", command);
                 return 1;
             }
 
             if (show_help_text) {
-                fmt::print("{}\n", iter->second->help_text());
+                fmt::print("{}\n", cli->help_text());
                 return 0;
             }
 
-            auto remaining_args = po::collect_unrecognized(parsed.options, po::include_positional);
+            load_client_api_plugins();
+
             remaining_args.erase(std::begin(remaining_args));
-            return iter->second->execute(remaining_args);
+            return cli->execute(remaining_args);
         }
         else if (show_help_text) {
-            print_usage_info(cli);
+            print_usage_info(vm);
         }
     }
     catch (const std::exception& e) {
@@ -90,43 +152,271 @@ int main(int argc, char* argv[])
     return 0;
 }
 
+#ifdef IRODS_CLI_STATIC_COMMANDS
+auto find_cli_command(const po::variables_map&, const std::string& name) -> boost::shared_ptr<irods::cli::command>
+{
+    if (const auto* entry = static_commands.find(name); entry) {
+        // Compiled-in commands live as long as the program.
+        return {&entry->get(), [](irods::cli::command*) {}};
+    }
+
+    return nullptr;
+}
+#else
+auto find_cli_command(const po::variables_map& vm, const std::string& name) -> boost::shared_ptr<irods::cli::command>
+{
+    const auto lib_dir = get_cli_plugin_directory(vm);
+    auto manifest = load_cli_plugin_manifest(lib_dir, false);
+    auto iter = manifest.find(name);
+
+    // A library replaced in place leaves the directory untouched.
+    if (std::end(manifest) != iter && file_version(iter->second.library) != iter->second.library_version) {
+        manifest = load_cli_plugin_manifest(lib_dir, true);
+        iter = manifest.find(name);
+    }
+
+    if (std::end(manifest) == iter) {
+        return nullptr;
+    }
+
+    return load_cli_command_plugin(iter->second);
+}
+
 auto is_shared_library(const fs::path& p) -> bool
 {
-    // TODO
-    return true;
+    if (!fs::is_regular_file(p)) {
+        return false;
+    }
+
+    char magic[4]{};
+    std::ifstream in{p.string(), std::ios::binary};
+
+    return in.read(magic, sizeof(magic)) && std::memcmp(magic, "\x7f" "ELF", sizeof(magic)) == 0;
 }
 
-auto load_cli_command_plugins(const po::variables_map& vm) -> cli_command_map_type
+auto get_cli_plugin_directory(const po::variables_map& vm) -> fs::path
 {
-    cli_command_map_type map;
+    if (vm.count("plugin-home")) {
+        return vm["plugin-home"].as<std::string>();
+    }
+
+    rodsEnv env;
+    _getRodsEnv(env);
+
     fs::path lib_dir;
 
-    if (vm.count("plugin-home")) {
-        lib_dir = vm["plugin-home"].as<std::string>();
+    if (std::strlen(env.irodsPluginHome) > 0) {
+        lib_dir = env.irodsPluginHome;
     }
     else {
-        rodsEnv env;
-        _getRodsEnv(env);
+        lib_dir = irods::get_irods_default_plugin_directory();
+    }
 
-        if (std::strlen(env.irodsPluginHome) > 0) {
-            lib_dir = env.irodsPluginHome;
-        }
-        else {
-            lib_dir = irods::get_irods_default_plugin_directory();
-        }
+    return lib_dir / "cli";
+}
+
+// Identifies the contents of a file or directory by its modification time (in
+// nanoseconds), inode and size.
+auto file_version(const fs::path& p) -> std::string
+{
+    struct stat st;
+
+    if (::stat(p.c_str(), &st) != 0) {
+        return {};
+    }
+
+    return fmt::format("{}.{:09}:{}:{}", st.st_mtim.tv_sec, st.st_mtim.tv_nsec, st.st_ino, st.st_size);
+}
+
+auto manifest_cache_path(const fs::path& lib_dir) -> std::optional<fs::path>
+{
+    const char* home = std::getenv("HOME");
+
+    if (!home || !*home) {
+        return std::nullopt;
+    }
+
+    // FNV-1a, so that the same directory maps to the same file across builds.
+    std::uint64_t hash = 14695981039346656037ull;
+
+    for (auto c : fs::absolute(lib_dir).string()) {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+    }
+
+    fs::path p = home;
+    p /= ".irods";
+    p /= "cli_plugins_" + std::to_string(hash) + ".manifest";
+
+    return p;
+}
 
-        lib_dir /= "cli";
+// The manifest file starts with the directory and its version, followed by one
+// line per command:
+//
+//   <name> TAB <library> TAB <library version> TAB <description>
+auto load_cli_plugin_manifest(const fs::path& lib_dir, bool rebuild) -> cli_plugin_manifest
+{
+    cli_plugin_manifest manifest;
+
+    const auto cache_path = manifest_cache_path(lib_dir);
+    const auto header = fs::absolute(lib_dir).string() + '\t' + file_version(lib_dir);
+
+    if (cache_path && !rebuild) {
+        if (std::ifstream in{cache_path->string()}; in) {
+            std::string line;
+
+            if (std::getline(in, line) && line == header) {
+                while (std::getline(in, line)) {
+                    std::istringstream fields{line};
+                    std::string name, library;
+                    cli_plugin_info info;
+
+                    if (std::getline(fields, name, '\t') && std::getline(fields, library, '\t') &&
+                        std::getline(fields, info.library_version, '\t') && std::getline(fields, info.description))
+                    {
+                        info.library = library;
+                        manifest.insert_or_assign(std::move(name), std::move(info));
+                    }
+                }
+
+                return manifest;
+            }
+        }
     }
 
+    // Building the manifest requires loading every plugin once.
     for (auto&& e : fs::directory_iterator{lib_dir}) {
         if (is_shared_library(e)) {
-            namespace dll = boost::dll;
-            auto cli_impl = dll::import<irods::cli::command>(e.path(), "cli_impl", dll::load_mode::append_decorations);
-            map.insert_or_assign(cli_impl->name(), cli_impl);
+            auto cli_impl = load_cli_command_plugin({{}, e.path(), {}});
+
+            auto& info = manifest[std::string{cli_impl->name()}];
+            info.description = cli_impl->description();
+            info.library = e.path();
+            info.library_version = file_version(e.path());
+
+            // Keeps every entry on a single line.
+            for (auto& c : info.description) {
+                if (c == '\t' || c == '\n') {
+                    c = ' ';
+                }
+            }
+        }
+    }
+
+    if (!cache_path) {
+        return manifest;
+    }
+
+    // The cache is only an optimization; the manifest is used either way. It is
+    // written to a temporary file first so concurrent invocations never read a
+    // partial manifest.
+    boost::system::error_code ec;
+    fs::create_directories(cache_path->parent_path(), ec);
+
+    const auto temporary = cache_path->string() + '.' + std::to_string(::getpid());
+
+    if (std::ofstream out{temporary}; out) {
+        out << header << '\n';
+
+        for (auto&& [name, info] : manifest) {
+            out << name << '\t' << info.library.string() << '\t' << info.library_version << '\t' << info.description << '\n';
+        }
+
+        if (out.flush()) {
+            fs::rename(temporary, *cache_path, ec);
+        }
+    }
+
+    fs::remove(temporary, ec);
+
+    return manifest;
+}
+
+auto load_cli_command_plugin(const cli_plugin_info& plugin) -> boost::shared_ptr<irods::cli::command>
+{
+    namespace dll = boost::dll;
+    return dll::import<irods::cli::command>(plugin.library, "cli_impl", dll::load_mode::append_decorations);
+}
+
+#endif // IRODS_CLI_STATIC_COMMANDS
+
+auto run_agent(const po::variables_map& vm, const std::vector<std::string>& args) -> int
+{
+    irods::cli::agent::options agent_options;
+
+    po::options_description desc{""};
+    desc.add_options()
+        ("workers,w", po::value<int>(&agent_options.workers)->default_value(agent_options.workers), "")
+        ("connections,c", po::value<int>(&agent_options.connections)->default_value(agent_options.connections), "");
+
+    po::variables_map agent_vm;
+    po::store(po::command_line_parser(args).options(desc).run(), agent_vm);
+    po::notify(agent_vm);
+
+    if (agent_options.workers < 1 || agent_options.connections < 1) {
+        std::cerr << "Error: The number of workers and connections must be greater than zero.\n";
+        return 1;
+    }
+
+    rodsEnv env;
+
+    if (getRodsEnv(&env) < 0) {
+        std::cerr << "Error: Could not get iRODS environment.\n";
+        return 1;
+    }
+
+    return irods::cli::agent::serve(env, agent_options, [&vm](const std::string& name) {
+        return find_cli_command(vm, name);
+    });
+}
+
+auto run_batch(const po::variables_map& vm, const std::vector<std::string>& args) -> int
+{
+    irods::cli::batch::options batch_options;
+
+    po::options_description desc{""};
+    desc.add_options()
+        ("file", po::value<std::string>(), "")
+        ("jobs,j", po::value<int>(&batch_options.jobs)->default_value(batch_options.jobs), "")
+        ("connections,c", po::value<int>(&batch_options.connections)->default_value(batch_options.connections), "")
+        ("report", po::value<std::string>(&batch_options.report), "");
+
+    po::positional_options_description pod;
+    pod.add("file", 1);
+
+    po::variables_map batch_vm;
+    po::store(po::command_line_parser(args).options(desc).positional(pod).run(), batch_vm);
+    po::notify(batch_vm);
+
+    if (batch_options.jobs < 1 || batch_options.connections < 1) {
+        std::cerr << "Error: The number of jobs and connections must be greater than zero.\n";
+        return 1;
+    }
+
+    rodsEnv env;
+
+    if (getRodsEnv(&env) < 0) {
+        std::cerr << "Error: Could not get iRODS environment.\n";
+        return 1;
+    }
+
+    const auto find = [&vm](const std::string& name) { return find_cli_command(vm, name); };
+
+    if (batch_vm.count("file") && batch_vm["file"].as<std::string>() != "-") {
+        const auto path = batch_vm["file"].as<std::string>();
+        std::ifstream in{path};
+
+        if (!in) {
+            std::cerr << "Error: Cannot open batch file [path: " << path << "].\n";
+            return 1;
         }
+
+        batch_options.input_is_stdin = false;
+
+        return irods::cli::batch::run(in, env, batch_options, find);
     }
 
-    return map;
+    return irods::cli::batch::run(std::cin, env, batch_options, find);
 }
 
 auto print_version_info() noexcept -> void
@@ -134,17 +424,28 @@ auto print_version_info() noexcept -> void
     fmt::print("irods cli version {}\n", IRODS_CLI_VERSION); // Defined by CMakeLists.txt
 }
 
-auto print_usage_info(const cli_command_map_type& cli) -> void
+auto print_usage_info(const po::variables_map& vm) -> void
 {
     fmt::print("usage: irods [-v | --version] [-p | --plugin-home <dir>] [-h | --help]\n"
                "usage: irods [-p | --plugin-home <dir>] <command> [<args>]\n"
+               "usage: irods [-p | --plugin-home <dir>] agent [-w | --workers <n>] [-c | --connections <n>]\n"
+               "usage: irods [-p | --plugin-home <dir>] batch [-j | --jobs <n>] [-c | --connections <n>] [--report <file>] [<file>]\n"
                "\n"
                "These are common iRODS commands used in various situations:\n"
                "\n");
 
-    for (auto&& [name, impl] : cli) {
-        fmt::print("{:<10} {}\n", name, impl->description());
+    fmt::print("{:<10} {}\n", "agent", "Serves commands to scripts with warm connections.");
+    fmt::print("{:<10} {}\n", "batch", "Runs the commands of a file, one per line, sharing plugins and connections.");
+
+#ifdef IRODS_CLI_STATIC_COMMANDS
+    for (auto&& e : static_commands) {
+        fmt::print("{:<10} {}\n", e.name, e.get().description());
+    }
+#else
+    for (auto&& [name, info] : load_cli_plugin_manifest(get_cli_plugin_directory(vm), false)) {
+        fmt::print("{:<10} {}\n", name, info.description);
     }
+#endif
 
     fmt::print("\n");
 }
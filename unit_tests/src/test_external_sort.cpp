@@ -0,0 +1,134 @@
+#include <catch2/catch.hpp>
+
+#include "external_sort.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using irods::cli::external_sorter;
+
+namespace
+{
+    constexpr std::size_t memory_limit = 1 << 20;
+
+    auto sorted_keys(external_sorter& _sorter, std::size_t _key_size) -> std::vector<std::string>
+    {
+        std::vector<std::string> keys;
+        _sorter.for_each([&keys, _key_size](std::string_view _r) { keys.emplace_back(_r.substr(0, _key_size)); });
+        return keys;
+    }
+
+    // Returns _count distinct fixed-size keys in random order.
+    auto random_keys(std::size_t _count) -> std::vector<std::string>
+    {
+        std::mt19937_64 rng{_count};
+        std::vector<std::string> keys;
+
+        for (std::size_t i = 0; i < _count; ++i) {
+            auto key = std::to_string(rng());
+            keys.push_back(std::string(20 - key.size(), '0') + key + std::to_string(i % 10));
+        }
+
+        return keys;
+    }
+} // anonymous namespace
+
+TEST_CASE("records are returned in byte order")
+{
+    external_sorter sorter{memory_limit};
+
+    for (const char* r : {"b", "a\xff", "a", "", "a\x01", "\x80", "ab"}) {
+        sorter.add(r);
+    }
+
+    const std::vector<std::string> expected{"", "a", "a\x01", "ab", "a\xff", "b", "\x80"};
+    CHECK(sorted_keys(sorter, std::string::npos) == expected);
+    CHECK(sorter.run_count() == 0);
+}
+
+TEST_CASE("records containing NUL bytes are kept whole")
+{
+    using namespace std::string_literals;
+
+    external_sorter sorter{memory_limit};
+    sorter.add("a\0b"s);
+    sorter.add("a"s);
+    sorter.add("a\0a"s);
+
+    const std::vector<std::string> expected{"a"s, "a\0a"s, "a\0b"s};
+    CHECK(sorted_keys(sorter, std::string::npos) == expected);
+}
+
+TEST_CASE("more runs than the merge fan-in are merged in order")
+{
+    // Every record is 4 KiB, so the 1 MiB buffer spills about every 250 records.
+    const auto keys = random_keys(20'000);
+    const std::string padding(4096 - keys.front().size(), 'x');
+
+    external_sorter sorter{memory_limit};
+
+    for (auto&& k : keys) {
+        sorter.add(k + padding);
+    }
+
+    REQUIRE(sorter.run_count() > 64);
+
+    auto expected = keys;
+    std::sort(expected.begin(), expected.end());
+    CHECK(sorted_keys(sorter, keys.front().size()) == expected);
+}
+
+TEST_CASE("a limit returns only the first records")
+{
+    const auto keys = random_keys(20'000);
+    const std::string padding(4096 - keys.front().size(), 'x');
+
+    auto expected = keys;
+    std::sort(expected.begin(), expected.end());
+
+    SECTION("pruning keeps small limits in memory")
+    {
+        external_sorter sorter{memory_limit, 10};
+
+        for (auto&& k : keys) {
+            sorter.add(k + padding);
+        }
+
+        CHECK(sorter.run_count() == 0);
+        expected.resize(10);
+        CHECK(sorted_keys(sorter, keys.front().size()) == expected);
+    }
+
+    SECTION("limits larger than half of the memory spill")
+    {
+        external_sorter sorter{memory_limit, 1000};
+
+        for (auto&& k : keys) {
+            sorter.add(k + padding);
+        }
+
+        CHECK(sorter.run_count() > 0);
+        expected.resize(1000);
+        CHECK(sorted_keys(sorter, keys.front().size()) == expected);
+    }
+
+    SECTION("a limit of zero returns nothing")
+    {
+        external_sorter sorter{memory_limit, 0};
+        sorter.add("a");
+        CHECK(sorted_keys(sorter, std::string::npos).empty());
+    }
+}
+
+TEST_CASE("the sorter is empty after for_each")
+{
+    external_sorter sorter{memory_limit};
+    sorter.add("a");
+    CHECK(sorted_keys(sorter, std::string::npos).size() == 1);
+    CHECK(sorted_keys(sorter, std::string::npos).empty());
+}
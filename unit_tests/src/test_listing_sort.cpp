@@ -0,0 +1,138 @@
+#include <catch2/catch.hpp>
+
+#include "listing_sort.hpp"
+
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <utility>
+#include <vector>
+
+using irods::cli::listing_sorter;
+using irods::cli::replica_entry;
+using irods::cli::sort_key;
+using irods::cli::sort_options;
+
+namespace
+{
+    auto make_entry(std::string _name, std::uintmax_t _size, std::time_t _mtime, int _replica_number = 0) -> replica_entry
+    {
+        replica_entry e{};
+        e.name = std::move(_name);
+        e.replica_number = _replica_number;
+        e.resource = "demoResc";
+        e.owner = "rods";
+        e.size = _size;
+        e.mtime = _mtime;
+        e.good = true;
+        return e;
+    }
+
+    auto sorted_names(sort_key _key, bool _reverse, const std::vector<replica_entry>& _entries) -> std::vector<std::string>
+    {
+        sort_options options;
+        options.key = _key;
+        options.reverse = _reverse;
+
+        listing_sorter sorter{options};
+
+        for (auto&& e : _entries) {
+            sorter.add(e);
+        }
+
+        std::vector<std::string> names;
+        sorter.for_each([&names](const replica_entry& _e) { names.push_back(_e.name); });
+        return names;
+    }
+} // anonymous namespace
+
+TEST_CASE("names sort before their extensions")
+{
+    const std::vector<replica_entry> entries{make_entry("ab.c", 0, 0), make_entry("b", 0, 0), make_entry("ab", 0, 0)};
+
+    CHECK(sorted_names(sort_key::name, false, entries) == std::vector<std::string>{"ab", "ab.c", "b"});
+    CHECK(sorted_names(sort_key::name, true, entries) == std::vector<std::string>{"b", "ab.c", "ab"});
+}
+
+TEST_CASE("sizes sort largest first")
+{
+    const std::vector<replica_entry> entries{make_entry("small", 1, 0),
+                                             make_entry("large", std::uintmax_t{1} << 40, 0),
+                                             make_entry("medium", 256, 0)};
+
+    CHECK(sorted_names(sort_key::size, false, entries) == std::vector<std::string>{"large", "medium", "small"});
+    CHECK(sorted_names(sort_key::size, true, entries) == std::vector<std::string>{"small", "medium", "large"});
+}
+
+TEST_CASE("times sort most recent first, including times before 1970")
+{
+    const std::vector<replica_entry> entries{make_entry("epoch", 0, 0),
+                                             make_entry("before", 0, -100),
+                                             make_entry("after", 0, 100)};
+
+    CHECK(sorted_names(sort_key::time, false, entries) == std::vector<std::string>{"after", "epoch", "before"});
+    CHECK(sorted_names(sort_key::time, true, entries) == std::vector<std::string>{"before", "epoch", "after"});
+}
+
+TEST_CASE("replicas of a data object stay in ascending order")
+{
+    sort_options options;
+    options.key = sort_key::size;
+
+    listing_sorter sorter{options};
+    sorter.add(make_entry("a", 10, 0, 2));
+    sorter.add(make_entry("a", 10, 0, 0));
+    sorter.add(make_entry("a", 10, 0, 1));
+
+    std::vector<int> replicas;
+    sorter.for_each([&replicas](const replica_entry& _e) { replicas.push_back(_e.replica_number); });
+    CHECK(replicas == std::vector<int>{0, 1, 2});
+}
+
+TEST_CASE("every field survives encoding")
+{
+    auto in = make_entry("name", 12345, -42, 3);
+    in.good = false;
+    in.checksum = "sha2:abc";
+    in.data_type = "generic";
+    in.physical_path = "/var/lib/irods/Vault/name";
+
+    sort_options options;
+    options.key = sort_key::time;
+
+    listing_sorter sorter{options};
+    sorter.add(in);
+
+    int count = 0;
+    sorter.for_each([&](const replica_entry& _out) {
+        ++count;
+        CHECK(_out.name == in.name);
+        CHECK(_out.replica_number == in.replica_number);
+        CHECK(_out.resource == in.resource);
+        CHECK(_out.owner == in.owner);
+        CHECK(_out.size == in.size);
+        CHECK(_out.mtime == in.mtime);
+        CHECK(_out.good == in.good);
+        CHECK(_out.checksum == in.checksum);
+        CHECK(_out.data_type == in.data_type);
+        CHECK(_out.physical_path == in.physical_path);
+    });
+    CHECK(count == 1);
+}
+
+TEST_CASE("head keeps the first entries")
+{
+    sort_options options;
+    options.key = sort_key::name;
+    options.head = 2;
+
+    listing_sorter sorter{options};
+
+    for (auto&& n : {"d", "b", "a", "c"}) {
+        sorter.add(make_entry(n, 0, 0));
+    }
+
+    std::vector<std::string> names;
+    sorter.for_each([&names](const replica_entry& _e) { names.push_back(_e.name); });
+    CHECK(names == std::vector<std::string>{"a", "b"});
+}
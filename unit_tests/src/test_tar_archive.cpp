@@ -0,0 +1,105 @@
+#include <catch2/catch.hpp>
+
+#include "tar_archive.hpp"
+
+#include <cstdint>
+#include <ctime>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace tar = irods::cli::tar;
+
+namespace
+{
+    auto add_file(std::ostream& _out, const std::string& _name, const std::string& _content) -> void
+    {
+        tar::write_header(_out, _name, _content.size(), 1'600'000'000, 0644, tar::entry_type::regular_file);
+        _out.write(_content.data(), static_cast<std::streamsize>(_content.size()));
+        tar::write_padding(_out, _content.size());
+    }
+
+    auto read_entries(std::istream& _in) -> std::vector<tar::entry>
+    {
+        std::vector<tar::entry> entries;
+        tar::for_each_entry(_in, [&entries](const tar::entry& _e) { entries.push_back(_e); });
+        return entries;
+    }
+} // anonymous namespace
+
+TEST_CASE("entries round trip")
+{
+    // A name that only fits into the prefix and name fields, and one that does
+    // not fit at all and needs a GNU long name.
+    const auto split_name = std::string(150, 'p') + '/' + std::string(90, 'n');
+    const auto long_name = std::string(300, 'l');
+
+    std::stringstream archive;
+    add_file(archive, "short", "hello");
+    add_file(archive, split_name, std::string(513, 'x'));
+    add_file(archive, long_name, "");
+    tar::write_header(archive, "dir", 0, 1'600'000'000, 0755, tar::entry_type::directory);
+    tar::write_end_of_archive(archive);
+
+    CHECK(archive.str().size() % tar::block_size == 0);
+
+    const auto entries = read_entries(archive);
+    REQUIRE(entries.size() == 4);
+
+    CHECK(entries[0].name == "short");
+    CHECK(entries[0].size == 5);
+    CHECK(entries[0].mtime == 1'600'000'000);
+    CHECK(entries[0].mode == 0644);
+    CHECK(entries[0].type == static_cast<char>(tar::entry_type::regular_file));
+
+    CHECK(entries[1].name == split_name);
+    CHECK(entries[1].size == 513);
+
+    CHECK(entries[2].name == long_name);
+    CHECK(entries[2].size == 0);
+
+    CHECK(entries[3].name == "dir/");
+    CHECK(entries[3].mode == 0755);
+    CHECK(entries[3].type == static_cast<char>(tar::entry_type::directory));
+}
+
+TEST_CASE("padded sizes are whole blocks")
+{
+    CHECK(tar::padded_size(0) == 0);
+    CHECK(tar::padded_size(1) == tar::block_size);
+    CHECK(tar::padded_size(tar::block_size) == tar::block_size);
+    CHECK(tar::padded_size(tar::block_size + 1) == 2 * tar::block_size);
+}
+
+TEST_CASE("oversized long names are rejected")
+{
+    std::stringstream archive;
+    add_file(archive, std::string(tar::detail::max_long_name_length + 1, 'l'), "");
+    tar::write_end_of_archive(archive);
+
+    CHECK_THROWS_WITH(read_entries(archive), Catch::Contains("Invalid tar long name"));
+}
+
+TEST_CASE("corrupt headers are rejected")
+{
+    std::stringstream archive;
+    add_file(archive, "short", "hello");
+    tar::write_end_of_archive(archive);
+
+    auto bytes = archive.str();
+    bytes[0] = 'S';
+    std::istringstream corrupt{bytes};
+
+    CHECK_THROWS_WITH(read_entries(corrupt), "Invalid tar header checksum.");
+}
+
+TEST_CASE("truncated long names are rejected")
+{
+    std::stringstream archive;
+    add_file(archive, std::string(300, 'l'), "");
+
+    std::istringstream truncated{archive.str().substr(0, tar::block_size + 100)};
+
+    CHECK_THROWS_WITH(read_entries(truncated), "Truncated tar archive.");
+}
@@ -0,0 +1,97 @@
+#include <catch2/catch.hpp>
+
+#include "listing_formatter.hpp"
+
+#include <cstdlib>
+#include <ctime>
+#include <random>
+#include <string>
+
+using irods::cli::timestamp_cache;
+
+namespace
+{
+    auto format_uncached(std::time_t _time) -> std::string
+    {
+        std::tm tm;
+        localtime_r(&_time, &tm);
+
+        char text[64];
+        return {text, std::strftime(text, sizeof(text), "%F %T", &tm)};
+    }
+
+    // Sets the local time zone for the lifetime of the object.
+    class time_zone
+    {
+    public:
+        explicit time_zone(const char* _tz)
+        {
+            if (const char* tz = std::getenv("TZ")) {
+                previous_ = tz;
+                had_previous_ = true;
+            }
+
+            ::setenv("TZ", _tz, 1);
+            ::tzset();
+        }
+
+        time_zone(const time_zone&) = delete;
+        auto operator=(const time_zone&) -> time_zone& = delete;
+
+        ~time_zone()
+        {
+            if (had_previous_) {
+                ::setenv("TZ", previous_.c_str(), 1);
+            }
+            else {
+                ::unsetenv("TZ");
+            }
+
+            ::tzset();
+        }
+
+    private:
+        std::string previous_;
+        bool had_previous_ = false;
+    }; // class time_zone
+} // anonymous namespace
+
+TEST_CASE("cached timestamps match strftime")
+{
+    // Lord Howe Island moves its clocks by half an hour and Nepal is offset by
+    // 45 minutes, which exercises the quarter-hour windows.
+    const auto* tz = GENERATE("UTC", "America/New_York", "Australia/Lord_Howe", "Asia/Kathmandu");
+    const time_zone zone{tz};
+
+    timestamp_cache cache;
+
+    SECTION("consecutive seconds across DST transitions")
+    {
+        // 2021-03-14 in New York and 2021-04-04 on Lord Howe Island.
+        for (const std::time_t start : {std::time_t{1615701600}, std::time_t{1617463800}}) {
+            for (std::time_t t = start; t < start + 4 * 3600; t += 7) {
+                REQUIRE(std::string{cache.format(t)} == format_uncached(t));
+            }
+        }
+    }
+
+    SECTION("random times, repeated and going backwards")
+    {
+        std::mt19937 rng{42};
+        std::uniform_int_distribution<std::time_t> jump{-2000, 2000};
+        std::time_t t = 1'600'000'000;
+
+        for (int i = 0; i < 100'000; ++i) {
+            t += i % 1000 == 0 ? 86'400 * 37 : jump(rng);
+            REQUIRE(std::string{cache.format(t)} == format_uncached(t));
+            REQUIRE(std::string{cache.format(t)} == format_uncached(t));
+        }
+    }
+
+    SECTION("times before 1970")
+    {
+        for (const std::time_t t : {std::time_t{-1}, std::time_t{-86'400}, std::time_t{-1'000'000'000}}) {
+            REQUIRE(std::string{cache.format(t)} == format_uncached(t));
+        }
+    }
+}